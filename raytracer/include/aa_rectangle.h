@@ -7,10 +7,13 @@
 #ifndef RUDNICKRT_AA_RECTANGLE_H
 #define RUDNICKRT_AA_RECTANGLE_H
 
+#include <vector>
+
 #include "aabb.h"
 #include "hittable.h"
 #include "material.h"
 #include "ray.h"
+#include "sampler.h"
 #include "utils.h"
 
 namespace rudnick_rt {
@@ -39,8 +42,23 @@ public:
     virtual bool hit(const Ray& ray, double tmin, double tmax, 
                      hit_record& record) const override;
 
+    virtual void surfaceDetails(const Ray& ray,
+                                hit_record& record) const override;
+
+    virtual bool occluded(const Ray& ray, double tmin,
+                          double tmax) const override;
+
     virtual bool boundingBox(AABB& output) const override;
 
+    virtual double pdfValue(const Point3 & origin,
+                            const Vec3 & direction) const override;
+
+    virtual Vec3 random(const Point3 & origin,
+                        Sampler & sampler) const override;
+
+    virtual void collectLights(
+        std::vector<const Hittable *> & lights) const override;
+
 private:
     shared_ptr<Material> m_;
     double x0_, x1_, y0_, y1_, k_;
@@ -71,8 +89,23 @@ public:
     virtual bool hit(const Ray& ray, double tmin, double tmax, 
                      hit_record& record) const override;
 
+    virtual void surfaceDetails(const Ray& ray,
+                                hit_record& record) const override;
+
+    virtual bool occluded(const Ray& ray, double tmin,
+                          double tmax) const override;
+
     virtual bool boundingBox(AABB& output) const override;
 
+    virtual double pdfValue(const Point3 & origin,
+                            const Vec3 & direction) const override;
+
+    virtual Vec3 random(const Point3 & origin,
+                        Sampler & sampler) const override;
+
+    virtual void collectLights(
+        std::vector<const Hittable *> & lights) const override;
+
 private:
     shared_ptr<Material> m_;
     double y0_, y1_, z0_, z1_, k_;
@@ -98,8 +131,23 @@ public:
 
     virtual bool hit(const Ray& ray, double tmin, double tmax, hit_record& record) const override;
 
+    virtual void surfaceDetails(const Ray& ray,
+                                hit_record& record) const override;
+
+    virtual bool occluded(const Ray& ray, double tmin,
+                          double tmax) const override;
+
     virtual bool boundingBox(AABB& output) const override;
 
+    virtual double pdfValue(const Point3 & origin,
+                            const Vec3 & direction) const override;
+
+    virtual Vec3 random(const Point3 & origin,
+                        Sampler & sampler) const override;
+
+    virtual void collectLights(
+        std::vector<const Hittable *> & lights) const override;
+
 private:
     shared_ptr<Material> m_;
     double x0_, x1_, z0_, z1_, k_;
@@ -31,6 +31,9 @@ public:
     /** @return The center point of the AABB. */
     Point3 centroid() const;
 
+    /** @return The total area of the six faces of the AABB. */
+    double surfaceArea() const;
+
     /**
      * Constructs an AABB with the given parameters.
      * @param a The first corner of the box.
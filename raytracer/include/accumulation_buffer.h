@@ -0,0 +1,127 @@
+/**
+ * @file accumulation_buffer.h
+ * @author Ian Rudnick
+ * Floating-point image that adds up samples as they are traced.
+ * Keeps the unclamped, linear sum of every pixel's samples and how many
+ * there were, so the image can be turned into a PNG at any point of a render
+ * and then keep getting samples afterwards.
+ *
+ * The buffer can also be saved to a checkpoint file and loaded back, to
+ * pick up a render where it stopped. The file is a small header followed by
+ * the raw pixels, 32 bytes each.
+ */
+#ifndef RUDNICKRT_ACCUMULATION_BUFFER_H
+#define RUDNICKRT_ACCUMULATION_BUFFER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "png.h"
+#include "vec3.h"
+
+namespace rudnick_rt {
+
+class AccumulationBuffer {
+public:
+    /**
+     * Running sums for the samples of one pixel.
+     * The luminance statistics are kept with Welford's method, in double
+     * precision. Summing squares in float loses the variance of bright
+     * pixels to rounding long before the render has enough samples.
+     */
+    struct Pixel {
+        float red = 0;
+        float green = 0;
+        float blue = 0;
+        uint32_t samples = 0;
+        double luminance_mean = 0;
+        // Sum of squared differences from the mean luminance.
+        double luminance_m2 = 0;
+
+        /**
+         * Adds one sample to the sums.
+         * @param color The color the sample traced.
+         */
+        void add(const RGBColor & color);
+
+        /** @return The average of the samples so far. */
+        RGBColor mean() const;
+
+        /**
+         * Estimates how far the average brightness might still be from the
+         * true brightness.
+         * @return One standard error of the mean luminance, or the largest
+         *         double with fewer than two samples.
+         */
+        double luminanceError() const;
+    };
+
+    /**
+     * Constructs an empty buffer with no samples.
+     * @param width Width of the image, in pixels.
+     * @param height Height of the image, in pixels.
+     */
+    AccumulationBuffer(int width, int height);
+
+    /**
+     * Gets a pixel. Like the renderer, (0, 0) is the lower-left corner.
+     */
+    Pixel & at(int x, int y) {
+        return pixels_[size_t(y) * width_ + x];
+    }
+    const Pixel & at(int x, int y) const {
+        return pixels_[size_t(y) * width_ + x];
+    }
+
+    /**
+     * Writes the current estimate of the image into a PNG, gamma-corrected
+     * and clamped. Pixels with no samples yet come out black.
+     * @param image The PNG to write to. Must be the buffer's size.
+     */
+    void toPNG(PNG & image) const;
+
+    /**
+     * Saves the buffer to a checkpoint file, replacing the file in one step
+     * so a crash while saving never leaves half a checkpoint behind.
+     * @param filename Where to save the checkpoint.
+     * @param key Hash of the settings the samples were made with.
+     * @return False if the file couldn't be written.
+     */
+    bool save(const std::string & filename, uint64_t key) const;
+
+    /**
+     * Loads the buffer from a checkpoint file.
+     * The buffer is left alone unless the whole file loads.
+     * @param filename The checkpoint to load.
+     * @param key Hash of the current settings. Must match the one the
+     *            checkpoint was saved with.
+     * @return False if there is no checkpoint, or it is for a different size
+     *         of image or different settings.
+     */
+    bool load(const std::string & filename, uint64_t key);
+
+    /** @return The total number of samples in the buffer. */
+    uint64_t totalSamples() const;
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+
+    /**
+     * Gets the brightness of a color, weighting each channel by how bright
+     * it looks (Rec. 709).
+     */
+    static double luminanceOf(const RGBColor & color) {
+        return 0.2126 * color.x() + 0.7152 * color.y() + 0.0722 * color.z();
+    }
+
+private:
+    int width_;
+    int height_;
+    std::vector<Pixel> pixels_;
+
+}; // class AccumulationBuffer
+
+} // namespace rudnick_rt
+
+#endif // RUDNICKRT_ACCUMULATION_BUFFER_H
@@ -2,7 +2,8 @@
  * @file bvh_tree.h
  * @author Ian Rudnick
  * Bounding Volume Hierarchy tree class for use in raytracing calculations.
- * Uses a class for the tree, and a nested class for the nodes.
+ * Builds a binary LinearBVH over a list of Hittables, then collapses it into
+ * a 4-wide WideBVH for traversal.
  * 
  * Based on Peter Shirley's Implementation in Ray Tracing: The Next Week,
  * and Physically Based Rendering.
@@ -15,60 +16,16 @@
 #include "aabb.h"
 #include "hittable.h"
 #include "hittable_list.h"
+#include "linear_bvh.h"
 #include "ray.h"
+#include "rrt_enum.h"
 #include "utils.h"
+#include "wide_bvh.h"
 
 
 namespace rudnick_rt {
 
 class BVHTree : public Hittable {
-//-----------------------------------------------------------------------------
-// BVH node class
-public:
-    class BVHNode : public Hittable {
-    public:
-        /**
-         * Constructs a default BVH Node.
-         */
-        BVHNode() {}
-
-        /**
-         * Constructs a BVH Node and fills out its children from a vector of
-         * Hittables.
-         * @param objects The vector of objects to determine the BVH.
-         * @param start
-         * @param end
-         */
-        BVHNode(const std::vector<shared_ptr<Hittable>> & objects,
-                size_t start, size_t end);
-
-        /**
-         * Determines whether a given ray hits the box at this node.
-         * @param ray The ray to check for a hit.
-         * @param tmin The minimum distance along the ray to detect a hit.
-         * @param tmax The maximum distance along the ray to detect a hit.
-         * @param record A hit_record to store the details of what was hit.
-         * @return True if the ray hits the box.
-         */
-        virtual bool hit(const Ray & ray, double tmin, double tmax,
-                         hit_record & record) const override;
-
-        /**
-         * Gets the bounding box of a BVH Node.
-         * @param box Output to store the bounding box.
-         * @return True if successful.
-         */
-        virtual bool boundingBox(AABB& box) const override;
-        
-    private:
-        shared_ptr<Hittable> left_;
-        shared_ptr<Hittable> right_;
-        AABB box_;
-    };
-
-//-----------------------------------------------------------------------------
-// BVH Tree Methods
-
 public:
     /**
      * Constructs an empty BVH Tree.
@@ -78,8 +35,14 @@ public:
     /**
      * Constructs a BVH Tree from a Hittable List.
      * @param list The Hittable List to determine the BVH.
+     * @param method How to choose where to split the objects at each node.
+     * @param max_leaf_size The most objects a leaf node can hold. With SAH,
+     *                      leaves are only made this big when it's cheaper
+     *                      than splitting them further.
      */
-    BVHTree(const HittableList & list);
+    BVHTree(const HittableList & list,
+            BVHSplitMethod method = BVHSplitMethod::SAH,
+            size_t max_leaf_size = 4);
 
     /**
      * Determines whether a given ray hits any objects in the tree.
@@ -92,6 +55,17 @@ public:
     virtual bool hit(const Ray & ray, double tmin, double tmax, 
                      hit_record & record) const override;
 
+    /**
+     * Determines whether anything in the tree blocks a ray. Stops at the
+     * first object it finds.
+     * @param ray The ray to check.
+     * @param tmin The minimum distance along the ray to detect a hit.
+     * @param tmax The maximum distance along the ray to detect a hit.
+     * @return True if the ray hits anything.
+     */
+    virtual bool occluded(const Ray & ray, double tmin,
+                          double tmax) const override;
+
     /**
      * Gets the bounding box of a BVH Tree.
      * @param box Output to store the bounding box.
@@ -99,8 +73,14 @@ public:
      */
     virtual bool boundingBox(AABB & box) const override;
 
+    virtual void collectLights(
+        std::vector<const Hittable *> & lights) const override;
+
 private:
-    shared_ptr<BVHNode> root_;
+    WideBVH bvh_;
+
+    // The objects, in the order the BVH's leaves refer to them.
+    std::vector<shared_ptr<Hittable>> objects_;
 
 };
    
@@ -9,6 +9,7 @@
 
 #include "ray.h"
 #include "rrt_enum.h"
+#include "sampler.h"
 #include "utils.h"
 #include "vec3.h"
 
@@ -43,6 +44,20 @@ public:
      */
     Ray getRay(double s, double t, RRTenum projection) const;
 
+    /**
+     * Gets a viewing ray through a random point on the lens, for depth of
+     * field. Objects at the focus distance stay sharp.
+     * Always draws two dimensions from the sampler, even without a lens.
+     * @param s The horizontal coordinate to point to.
+     * @param t The vertical coordinate to point to.
+     * @param projection The projection mode to use. Only PERSPECTIVE
+     *                   cameras have a lens.
+     * @param sampler Where to draw the point on the lens from.
+     * @return A ray from the lens to the given screen coordinates.
+     */
+    Ray getRay(double s, double t, RRTenum projection,
+               Sampler & sampler) const;
+
 private:
     Point3 origin_;
     Point3 lower_left_corner_;
@@ -7,24 +7,41 @@
 #ifndef RUDNICKRT_HITTABLE_H
 #define RUDNICKRT_HITTABLE_H
 
+#include <cstdint>
+#include <vector>
+
 #include "aabb.h"
 #include "material.h"
 #include "ray.h"
+#include "sampler.h"
 #include "vec3.h"
 
 namespace rudnick_rt {
 
 // forward declare?
 class Material;
+class Hittable;
 
+/**
+ * Details of a ray hit.
+ * Hittable::hit() only fills in what it takes to find the closest hit: t, u,
+ * v, the object and the primitive. The rest is left for
+ * Hittable::surfaceDetails(), which only runs once the closest hit is known.
+ */
 struct hit_record {
     Point3 point;
     Vec3 normal;
-    shared_ptr<Material> material;
+    // Non-owning. The object that was hit keeps its material alive, and
+    // a plain pointer avoids reference counting on every hit.
+    const Material * material;
     double t;
     double u;
     double v;
     bool hit_front_of_surface;
+    // The object that was hit, which can fill in the rest of the record.
+    const Hittable * object;
+    // Which part of the object was hit, for objects made of many pieces.
+    uint32_t primitive;
 
     inline void setNormalDirection(const Ray &ray, const Vec3 &surface_normal){
         hit_front_of_surface = (Vec3::dot(ray.direction(), surface_normal) < 0);
@@ -37,6 +54,12 @@ class Hittable {
 public:
     /**
      * Checks whether a given ray hits the hittable object.
+     * Only fills in t, u, v, object and primitive in the record. Use
+     * hitSurface() to get the point, normal, and material too.
+     * Containers find the closest hit by lowering tmax to each hit they
+     * get, so every object must only report the closest hit with
+     * tmin <= t <= tmax, and must leave the record alone when it returns
+     * false.
      * @param ray The ray to check for hit.
      * @param tmin The minimum distance to register a hit
      * @param tmax The maximum distance to register a hit
@@ -47,7 +70,77 @@ public:
         const Ray &ray, double tmin, double tmax, hit_record &record
     ) const = 0;
 
+    /**
+     * Fills in the point, normal, and material of a hit on this object,
+     * from the parts hit() recorded.
+     * Objects that put themselves in record.object must override this.
+     * @param ray The ray that made the hit.
+     * @param record The hit to finish.
+     */
+    virtual void surfaceDetails(const Ray &ray, hit_record &record) const {}
+
+    /**
+     * Finds the closest hit like hit(), then fills in the whole record for
+     * that hit alone.
+     * @param ray The ray to check for hit.
+     * @param tmin The minimum distance to register a hit
+     * @param tmax The maximum distance to register a hit
+     * @param record hit_record to log the details of the hit
+     * @return true if there was a hit
+     */
+    bool hitSurface(
+        const Ray &ray, double tmin, double tmax, hit_record &record
+    ) const {
+        if (!hit(ray, tmin, tmax, record))
+            return false;
+        record.object->surfaceDetails(ray, record);
+        return true;
+    }
+
+    /**
+     * Checks whether anything blocks a ray between two distances.
+     * Cheaper than hit() for shadow rays: it stops at the first hit it finds,
+     * and doesn't fill in a hit_record.
+     * @param ray The ray to check.
+     * @param tmin The minimum distance to register a hit
+     * @param tmax The maximum distance to register a hit
+     * @return true if there is any hit in [tmin, tmax]
+     */
+    virtual bool occluded(const Ray &ray, double tmin, double tmax) const = 0;
+
     virtual bool boundingBox(AABB& output) const = 0;
+
+    /**
+     * Gets the probability density of picking a direction with random(),
+     * measured over solid angle.
+     * Only objects that can be sampled as lights need to override this.
+     * @param origin The point the direction starts from.
+     * @param direction The direction to get the density of.
+     * @return The density, or 0 if random() never picks the direction.
+     */
+    virtual double pdfValue(const Point3 & origin,
+                            const Vec3 & direction) const {
+        return 0.0;
+    }
+
+    /**
+     * Picks a random direction from a point towards the object.
+     * Only objects that can be sampled as lights need to override this.
+     * @param origin The point the direction starts from.
+     * @param sampler Where to draw the random numbers from.
+     * @return A direction that hits the object. Not normalized.
+     */
+    virtual Vec3 random(const Point3 & origin, Sampler & sampler) const {
+        return Vec3(1, 0, 0);
+    }
+
+    /**
+     * Adds every emissive object that can be sampled as a light to a list.
+     * Containers pass the call on to what they hold.
+     * @param lights The list to add the lights to. Pointers are non-owning,
+     *               so the list must not outlive the scene.
+     */
+    virtual void collectLights(std::vector<const Hittable *> & lights) const {}
 };
 
 } // namespace rudnick_rt
@@ -26,9 +26,15 @@ public:
     virtual bool hit(const Ray & ray,
                      double tmin, double tmax, 
                      hit_record & record) const override;
+
+    virtual bool occluded(const Ray & ray, double tmin,
+                          double tmax) const override;
     
     virtual bool boundingBox(AABB& output) const override;
 
+    virtual void collectLights(
+        std::vector<const Hittable *> & lights) const override;
+
 public:
     std::vector<std::shared_ptr<Hittable>> objects_;
 
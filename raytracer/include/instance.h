@@ -7,75 +7,168 @@
 #ifndef RUDNICKRT_INSTANCE_H
 #define RUDNICKRT_INSTANCE_H
 
-#include "hittable.h"
+#include <memory>
 
+#include "hittable.h"
+#include "matrix34.h"
 #include "vec3.h"
 
 
 namespace rudnick_rt {
 
+class TriangleMesh;
+
 /**
- * Class for translations.
+ * Class for any affine transformation: translation, rotation, scale, or
+ * shear. Stores the matrix along with its inverse, so a ray only has to be
+ * multiplied into the object's space once, and a hit back out once.
+ * A Transform of a Transform is folded into one matrix when it's made, so a
+ * stack of them costs the same as a single one.
+ * Transforms finish the child's hit record as soon as the child reports a
+ * hit, then move it back into world space, so surfaceDetails() has nothing
+ * left to do.
  */
-class Translate : public Hittable {
+class Transform : public Hittable {
 public:
-    Translate(shared_ptr<Hittable> p, const Vec3 & displacement)
-        : ptr_(p), displacement_(displacement) {}
+    /**
+     * Constructs a transformed object.
+     * @param p The object to transform.
+     * @param matrix The transformation from the object's space to the
+     *               world's. It must be invertible.
+     */
+    Transform(shared_ptr<Hittable> p, const Matrix34 & matrix);
 
     virtual bool hit(
         const Ray & ray, double tmin, double tmax, hit_record & record
     ) const override;
 
+    virtual void surfaceDetails(const Ray & ray,
+                                hit_record & record) const override {}
+
+    virtual bool occluded(const Ray & ray, double tmin,
+                          double tmax) const override;
+
     virtual bool boundingBox(AABB & box) const override;
 
+    /** @return The transformation from the object's space to the world's. */
+    const Matrix34 & matrix() const { return matrix_; }
+
 private:
     shared_ptr<Hittable> ptr_;
-    Vec3 displacement_;
+    Matrix34 matrix_;
+    Matrix34 inverse_;
+    bool has_box_;
+    AABB box_;
+};
+
+
+/**
+ * Class for translations.
+ */
+class Translate : public Transform {
+public:
+    Translate(shared_ptr<Hittable> p, const Vec3 & displacement)
+        : Transform(p, Matrix34::translation(displacement)) {}
 };
 
 
 /**
  * Class for rotations about the y-axis.
  */
-class RotateY : public Hittable {
+class RotateY : public Transform {
+public:
+    RotateY(shared_ptr<Hittable> p, double angle)
+        : Transform(p, Matrix34::rotation(Vec3(0, 1, 0), angle)) {}
+};
+
+
+/**
+ * Class for copying an object with a different material.
+ */
+class Recolor : public Hittable {
 public:
-    RotateY(shared_ptr<Hittable> p, double angle);
+    Recolor(std::shared_ptr<Hittable> p, std::shared_ptr<Material> mat)
+        : ptr_(p), mat_(mat) {}
 
     virtual bool hit(
         const Ray & ray, double tmin, double tmax, hit_record & record
     ) const override;
 
+    virtual void surfaceDetails(const Ray & ray,
+                                hit_record & record) const override {}
+
+    virtual bool occluded(const Ray & ray, double tmin,
+                          double tmax) const override;
+
     virtual bool boundingBox(AABB & box) const override;
 
 private:
-    shared_ptr<Hittable> ptr_;
-    double sin_;
-    double cos_;
-    bool has_box_;
-    AABB box_;
+    std::shared_ptr<Hittable> ptr_;
+    std::shared_ptr<Material> mat_;
 };
 
 
 /**
- * Class for copying an object with a different material.
+ * One placement of a shared mesh, transformed and given its own material.
+ * Many instances can share a mesh, and its BVH, while only storing their
+ * own small transform, so put instances in a BVHTree to place a mesh many
+ * times. Unlike the other instances, this one waits for the closest hit
+ * before working out the hit's details.
  */
-class Recolor : public Hittable {
+class MeshInstance : public Hittable {
 public:
-    Recolor(std::shared_ptr<Hittable> p, std::shared_ptr<Material> mat)
-        : ptr_(p), mat_(mat) {}
+    /**
+     * Constructs a mesh instance.
+     * @param mesh The mesh to place, such as one from TriangleMesh::load().
+     * @param matrix The transformation from the mesh's space to the
+     *               world's. It must be invertible.
+     * @param mat Material for this instance. Must not be null: meshes from
+     *            TriangleMesh::load() have no material of their own.
+     */
+    MeshInstance(std::shared_ptr<const TriangleMesh> mesh,
+                 const Matrix34 & matrix,
+                 std::shared_ptr<Material> mat);
+
+    /**
+     * Constructs a mesh instance that's only moved.
+     * @param mesh The mesh to place, such as one from TriangleMesh::load().
+     * @param displacement Where to move the mesh to.
+     * @param mat Material for this instance. Must not be null.
+     */
+    MeshInstance(std::shared_ptr<const TriangleMesh> mesh,
+                 const Vec3 & displacement,
+                 std::shared_ptr<Material> mat)
+        : MeshInstance(mesh, Matrix34::translation(displacement), mat) {}
 
     virtual bool hit(
         const Ray & ray, double tmin, double tmax, hit_record & record
     ) const override;
 
+    virtual void surfaceDetails(const Ray & ray,
+                                hit_record & record) const override;
+
+    virtual bool occluded(const Ray & ray, double tmin,
+                          double tmax) const override;
+
     virtual bool boundingBox(AABB & box) const override;
 
 private:
-    std::shared_ptr<Hittable> ptr_;
+    /**
+     * Moves a ray into the mesh's space. The direction isn't normalized,
+     * so distances along the ray stay the same in both spaces.
+     */
+    Ray toLocal(const Ray & ray) const {
+        return Ray(inverse_.transformPoint(ray.origin()),
+                   inverse_.transformVector(ray.direction()));
+    }
+
+    std::shared_ptr<const TriangleMesh> mesh_;
+    Matrix34 matrix_;
+    Matrix34 inverse_;
     std::shared_ptr<Material> mat_;
 };
     
 } // namespace rudnick_rt
 
 
-#endif
\ No newline at end of file
+#endif
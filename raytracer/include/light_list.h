@@ -0,0 +1,89 @@
+/**
+ * @file light_list.h
+ * @author Ian Rudnick
+ * List of the emissive objects in a scene, for sampling lights directly.
+ * Picks a light uniformly at random, then a direction towards it, so the
+ * density of a direction is the average of every light's density.
+ */
+#ifndef RUDNICKRT_LIGHT_LIST_H
+#define RUDNICKRT_LIGHT_LIST_H
+
+#include <algorithm>
+#include <vector>
+
+#include "hittable.h"
+#include "sampler.h"
+#include "utils.h"
+#include "vec3.h"
+
+namespace rudnick_rt {
+
+class LightList {
+public:
+    /**
+     * Constructs an empty light list.
+     */
+    LightList() {}
+
+    /**
+     * Constructs a list of every light in a scene.
+     * The list holds non-owning pointers, so the scene must outlive it.
+     * @param world The scene to find the lights in.
+     */
+    explicit LightList(const Hittable & world) {
+        world.collectLights(lights_);
+    }
+
+    /**
+     * Gets the probability density of random() picking a direction,
+     * measured over solid angle.
+     * @param origin The point the direction starts from.
+     * @param direction The direction to get the density of.
+     * @return The density.
+     */
+    double pdfValue(const Point3 & origin, const Vec3 & direction) const {
+        if (lights_.empty()) return 0.0;
+        double sum = 0.0;
+        for (const auto light : lights_) {
+            sum += light->pdfValue(origin, direction);
+        }
+        return sum / lights_.size();
+    }
+
+    /**
+     * Picks one of the lights uniformly at random.
+     * Must not be called on an empty list.
+     * @param sampler Where to draw the random number from.
+     * @return The light.
+     */
+    const Hittable & pick(Sampler & sampler) const {
+        size_t index = static_cast<size_t>(sampler.get1D() * lights_.size());
+        return *lights_[std::min(index, lights_.size() - 1)];
+    }
+
+    /**
+     * Picks a random direction from a point towards one of the lights.
+     * Must not be called on an empty list.
+     * @param origin The point the direction starts from.
+     * @param sampler Where to draw the random numbers from.
+     * @return A direction towards a light. Not normalized.
+     */
+    Vec3 random(const Point3 & origin, Sampler & sampler) const {
+        const Hittable & light = pick(sampler);
+        return light.random(origin, sampler);
+    }
+
+    /** @return True if the scene has no lights to sample. */
+    bool empty() const { return lights_.empty(); }
+
+    /** @return The number of lights. */
+    size_t size() const { return lights_.size(); }
+
+private:
+    std::vector<const Hittable *> lights_;
+
+}; // class LightList
+
+} // namespace rudnick_rt
+
+#endif // RUDNICKRT_LIGHT_LIST_H
@@ -0,0 +1,122 @@
+/**
+ * @file linear_bvh.h
+ * @author Ian Rudnick
+ * Flattened Bounding Volume Hierarchy stored as one contiguous node array.
+ * Nodes are laid out depth-first, so a node's first child always comes right
+ * after it, and only the second child's offset has to be stored. Leaves hold
+ * a range of primitives, and the BVH user decides what a primitive is.
+ *
+ * Based on the LinearBVHNode layout in Physically Based Rendering.
+ */
+#ifndef RUDNICKRT_LINEAR_BVH_H
+#define RUDNICKRT_LINEAR_BVH_H
+
+#include <cstdint>
+#include <vector>
+
+#include "aabb.h"
+#include "ray.h"
+#include "rrt_enum.h"
+#include "vec3.h"
+
+namespace rudnick_rt {
+
+/**
+ * One node of a LinearBVH, packed into 32 bytes so two fit in a cache line.
+ * Bounds are stored as floats, rounded outwards so they never shrink.
+ */
+struct LinearBVHNode {
+    float min[3];
+    float max[3];
+    union {
+        uint32_t primitives_offset;    // leaf: index of the first primitive
+        uint32_t second_child_offset;  // interior: index of the second child
+    };
+    uint16_t num_primitives;           // 0 for interior nodes
+    uint8_t axis;                      // interior: axis the node was split on
+    uint8_t pad;
+
+    /**
+     * Slab test against the node's box.
+     * @param ray The ray to test, with its precomputed inverse direction.
+     * @param tmin The minimum distance along the ray to detect a hit.
+     * @param tmax The maximum distance along the ray to detect a hit.
+     * @return True if the ray hits the box between tmin and tmax.
+     */
+    bool hit(const Ray & ray, double tmin, double tmax) const {
+        const Vec3 & inv_dir = ray.invDirection();
+        const int * dir_is_neg = ray.dirIsNeg();
+        const float * bounds[2] = {min, max};
+        for (int i = 0; i < 3; ++i) {
+            double t0 = (bounds[dir_is_neg[i]][i] - ray.origin_[i]) * inv_dir[i];
+            double t1 = (bounds[1 - dir_is_neg[i]][i] - ray.origin_[i]) * inv_dir[i];
+            tmin = t0 > tmin ? t0 : tmin;
+            tmax = t1 < tmax ? t1 : tmax;
+            if (tmax < tmin) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+static_assert(sizeof(LinearBVHNode) == 32, "LinearBVHNode must be 32 bytes");
+
+
+class LinearBVH {
+public:
+    /**
+     * Constructs an empty BVH that nothing can hit.
+     */
+    LinearBVH() {}
+
+    /**
+     * Builds the BVH over a set of primitives.
+     * @param boxes Bounding box of each primitive.
+     * @param method How to choose where to split the primitives.
+     * @param max_leaf_size The most primitives a leaf node can hold.
+     * @param order Output for the primitive order. Leaves refer to primitives
+     *              by their position in this order, so the caller should
+     *              store its primitives in this order.
+     */
+    void build(const std::vector<AABB> & boxes, BVHSplitMethod method,
+               size_t max_leaf_size, std::vector<uint32_t> & order);
+
+    /**
+     * Spreads the primitive order out so that every leaf starts on a multiple
+     * of some alignment, filling the gaps with kEmptySlot. Useful when leaves
+     * are intersected several primitives at a time.
+     * @param alignment What each leaf's first primitive should be a multiple
+     *                  of.
+     * @param order The primitive order from build(). Padded in place.
+     */
+    void alignLeaves(uint32_t alignment, std::vector<uint32_t> & order);
+
+    /**
+     * Gets the bounding box of everything in the BVH.
+     * @param box Output to store the bounding box.
+     * @return True if the BVH is not empty.
+     */
+    bool boundingBox(AABB & box) const;
+
+    /** @return The number of nodes in the BVH. */
+    size_t numNodes() const { return nodes_.size(); }
+
+    /** @return The nodes of the BVH, in depth-first order. */
+    const std::vector<LinearBVHNode> & nodes() const { return nodes_; }
+
+    // Deepest tree build() makes. WideBVH sizes its traversal stack by it.
+    static const int kMaxDepth = 64;
+
+    // Marks padding in a primitive order made by alignLeaves().
+    static const uint32_t kEmptySlot = 0xffffffff;
+
+private:
+    std::vector<LinearBVHNode> nodes_;
+    AABB bounds_;
+
+}; // class LinearBVH
+
+} // namespace rudnick_rt
+
+#endif // RUDNICKRT_LINEAR_BVH_H
@@ -0,0 +1,59 @@
+/**
+ * @file mapped_file.h
+ * @author Ian Rudnick
+ * Read-only view of a whole file in memory.
+ * On POSIX systems the file is memory mapped, so opening it costs nothing
+ * up front and pages are only read in as they're touched. On Windows the
+ * file is read into a buffer instead.
+ */
+#ifndef RUDNICKRT_MAPPED_FILE_H
+#define RUDNICKRT_MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace rudnick_rt {
+
+class MappedFile {
+public:
+    /**
+     * Constructs a view of nothing.
+     */
+    MappedFile() : data_(nullptr), size_(0) {}
+
+    /**
+     * Opens a file and maps it into memory.
+     * @param filename Name of the file to open.
+     */
+    explicit MappedFile(const std::string & filename);
+
+    /**
+     * Unmaps the file. Pointers into it are no longer valid.
+     */
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile & operator=(const MappedFile &) = delete;
+
+    /** @return True if the file was opened and isn't empty. */
+    bool valid() const { return data_ != nullptr; }
+
+    /** @return The start of the file's contents. */
+    const char * data() const { return data_; }
+
+    /** @return The size of the file in bytes. */
+    size_t size() const { return size_; }
+
+private:
+    const char * data_;
+    size_t size_;
+#ifdef WIN32
+    std::vector<char> buffer_;
+#endif
+
+}; // class MappedFile
+
+} // namespace rudnick_rt
+
+#endif // RUDNICKRT_MAPPED_FILE_H
@@ -10,6 +10,7 @@
 
 #include "hittable.h"
 #include "ray.h"
+#include "sampler.h"
 #include "utils.h"
 #include "vec3.h"
 
@@ -25,12 +26,14 @@ public:
      * @param record a record of where the ray hit
      * @param attenuation place to store the color attenuation
      * @param scattered the scattered/bounced ray
+     * @param sampler where to draw the random numbers from
      * @return true if a ray was scattered
      */
     virtual bool scatter(const Ray & incident,
                          const hit_record & record,
                          RGBColor & attenuation,
-                         Ray & scattered) const = 0;
+                         Ray & scattered,
+                         Sampler & sampler) const = 0;
     
     /**
      * for emissive materials (from second Shirley book)
@@ -38,6 +41,50 @@ public:
     virtual RGBColor emitted(double u, double v, const Point3 & p) const {
         return RGBColor(0, 0, 0);
     }
+
+    /**
+     * @return True if the material gives off light, so objects made of it
+     * can be sampled as lights.
+     */
+    virtual bool isEmissive() const {
+        return false;
+    }
+
+    /**
+     * @return True if light can be sampled directly at hits on the material,
+     * meaning evaluate() and scatteringPdf() are implemented. Mirror-like
+     * materials that only scatter in one direction return false.
+     */
+    virtual bool isDiffuse() const {
+        return false;
+    }
+
+    /**
+     * Gets how much light coming from a direction the material reflects back
+     * along the incident ray. This is the BRDF times the cosine term.
+     * @param incident the incident ray
+     * @param record a record of where the ray hit
+     * @param direction direction the light comes from; need not be normalized
+     * @return the color the light gets multiplied by
+     */
+    virtual RGBColor evaluate(const Ray & incident, const hit_record & record,
+                              const Vec3 & direction) const {
+        return RGBColor(0, 0, 0);
+    }
+
+    /**
+     * Gets the probability density of scatter() picking a direction,
+     * measured over solid angle.
+     * @param incident the incident ray
+     * @param record a record of where the ray hit
+     * @param direction the scattered direction; need not be normalized
+     * @return the density
+     */
+    virtual double scatteringPdf(const Ray & incident,
+                                 const hit_record & record,
+                                 const Vec3 & direction) const {
+        return 0.0;
+    }
 };
 
 
@@ -45,10 +92,24 @@ class BasicLambertian : public Material {
 public:
     BasicLambertian(const RGBColor & albedo) : albedo_(albedo) {}
 
+    /**
+     * Scatters in a cosine-weighted random direction, so the attenuation is
+     * just the albedo.
+     */
     virtual bool scatter(const Ray & incident,
                          const hit_record & record,
                          RGBColor & attenuation,
-                         Ray & scattered) const override;
+                         Ray & scattered,
+                         Sampler & sampler) const override;
+
+    virtual bool isDiffuse() const override { return true; }
+
+    virtual RGBColor evaluate(const Ray & incident, const hit_record & record,
+                              const Vec3 & direction) const override;
+
+    virtual double scatteringPdf(const Ray & incident,
+                                 const hit_record & record,
+                                 const Vec3 & direction) const override;
 
 private:
     RGBColor albedo_;
@@ -63,7 +124,8 @@ public:
     virtual bool scatter(const Ray & incident,
                          const hit_record & record,
                          RGBColor & attenuation,
-                         Ray & scattered) const override;
+                         Ray & scattered,
+                         Sampler & sampler) const override;
 
 private:
     RGBColor albedo_;
@@ -79,7 +141,8 @@ public:
     virtual bool scatter(const Ray & incident,
                          const hit_record & record,
                          RGBColor & attenuation,
-                         Ray & scattered) const override;
+                         Ray & scattered,
+                         Sampler & sampler) const override;
 
 private:
     /**
@@ -103,7 +166,8 @@ public:
     virtual bool scatter(const Ray & incident,
                          const hit_record & record,
                          RGBColor & attenuation,
-                         Ray & scattered) const override {
+                         Ray & scattered,
+                         Sampler & sampler) const override {
         // this simple light source does not scatter any light rays that hit it
         return false;
     }
@@ -112,6 +176,8 @@ public:
         return color_;
     }
 
+    virtual bool isEmissive() const override { return true; }
+
 private:
     RGBColor color_;
 };
@@ -0,0 +1,111 @@
+/**
+ * @file matrix34.h
+ * @author Ian Rudnick
+ * 3x4 matrix class for affine transformations.
+ * The left 3x3 part holds the rotation, scale and shear, and the last column
+ * holds the translation. The bottom row of a full 4x4 matrix is always
+ * 0 0 0 1, so it isn't stored.
+ */
+#ifndef RUDNICKRT_MATRIX34_H
+#define RUDNICKRT_MATRIX34_H
+
+#include "aabb.h"
+#include "vec3.h"
+
+namespace rudnick_rt {
+
+class Matrix34 {
+public:
+    /**
+     * Constructs an identity matrix.
+     */
+    Matrix34();
+
+    /**
+     * Makes a matrix that moves points by a displacement.
+     * @param displacement How far to move along each axis.
+     * @return The translation matrix.
+     */
+    static Matrix34 translation(const Vec3 & displacement);
+
+    /**
+     * Makes a matrix that rotates about an axis through the origin.
+     * Rotations are counter-clockwise looking down the axis at the origin.
+     * @param axis The axis to rotate about. Doesn't need to be normalized.
+     * @param angle The angle to rotate by, in degrees.
+     * @return The rotation matrix.
+     */
+    static Matrix34 rotation(const Vec3 & axis, double angle);
+
+    /**
+     * Makes a matrix that scales about the origin.
+     * @param factors How much to scale along each axis.
+     * @return The scaling matrix.
+     */
+    static Matrix34 scaling(const Vec3 & factors);
+
+    /** @return The element at a row and column. */
+    double operator()(int row, int col) const { return m_[row][col]; }
+    double & operator()(int row, int col) { return m_[row][col]; }
+
+    /**
+     * Combines two transformations.
+     * @param a The transformation to apply second.
+     * @param b The transformation to apply first.
+     * @return A matrix that applies b, then a.
+     */
+    friend Matrix34 operator*(const Matrix34 & a, const Matrix34 & b);
+
+    /**
+     * Inverts the matrix. The matrix must not squash space flat, so no
+     * scale factor can be zero.
+     * @return The inverse transformation.
+     */
+    Matrix34 inverse() const;
+
+    /** @return A point moved by the transformation. */
+    Point3 transformPoint(const Point3 & p) const {
+        return Point3(
+            m_[0][0]*p[0] + m_[0][1]*p[1] + m_[0][2]*p[2] + m_[0][3],
+            m_[1][0]*p[0] + m_[1][1]*p[1] + m_[1][2]*p[2] + m_[1][3],
+            m_[2][0]*p[0] + m_[2][1]*p[1] + m_[2][2]*p[2] + m_[2][3]);
+    }
+
+    /** @return A direction changed by the transformation, ignoring the
+     *          translation. */
+    Vec3 transformVector(const Vec3 & v) const {
+        return Vec3(
+            m_[0][0]*v[0] + m_[0][1]*v[1] + m_[0][2]*v[2],
+            m_[1][0]*v[0] + m_[1][1]*v[1] + m_[1][2]*v[2],
+            m_[2][0]*v[0] + m_[2][1]*v[1] + m_[2][2]*v[2]);
+    }
+
+    /**
+     * Multiplies a vector by the transpose of the 3x3 part. Calling this on
+     * the inverse of a transformation carries a normal through it, keeping
+     * the normal perpendicular to the surface under any scale or shear.
+     * @param n The normal to transform.
+     * @return The transformed normal. Not normalized.
+     */
+    Vec3 transformNormal(const Vec3 & n) const {
+        return Vec3(
+            m_[0][0]*n[0] + m_[1][0]*n[1] + m_[2][0]*n[2],
+            m_[0][1]*n[0] + m_[1][1]*n[1] + m_[2][1]*n[2],
+            m_[0][2]*n[0] + m_[1][2]*n[1] + m_[2][2]*n[2]);
+    }
+
+    /**
+     * Finds the smallest axis-aligned box surrounding a transformed box.
+     * @param box The box to transform.
+     * @return The box surrounding all eight transformed corners.
+     */
+    AABB transformBox(const AABB & box) const;
+
+private:
+    double m_[3][4];
+
+}; // class Matrix34
+
+} // namespace rudnick_rt
+
+#endif // RUDNICKRT_MATRIX34_H
@@ -0,0 +1,65 @@
+/**
+ * @file octahedral.h
+ * @author Ian Rudnick
+ * Packs unit vectors into 32 bits with an octahedral mapping.
+ * The sphere of directions is projected onto an octahedron, which is
+ * unfolded into a square, and each coordinate of the square is stored as a
+ * 16-bit signed normalized integer. Decoded normals are within about 0.005
+ * degrees of the original, at a third of the size of three floats.
+ */
+#ifndef RUDNICKRT_OCTAHEDRAL_H
+#define RUDNICKRT_OCTAHEDRAL_H
+
+#include <cmath>
+#include <cstdint>
+
+#include "vec3.h"
+
+namespace rudnick_rt {
+
+/**
+ * Packs a unit vector into 32 bits.
+ * @param n The vector to pack. Must not be zero.
+ * @return x in the low 16 bits and y in the high 16 bits of the square.
+ */
+inline uint32_t encodeOctahedral(const Vec3 & n) {
+    double l1 = std::fabs(n.x()) + std::fabs(n.y()) + std::fabs(n.z());
+    double x = n.x() / l1;
+    double y = n.y() / l1;
+    // Fold the lower half of the octahedron out over the corners.
+    if (n.z() < 0) {
+        double folded_x = (1 - std::fabs(y)) * (x >= 0 ? 1 : -1);
+        double folded_y = (1 - std::fabs(x)) * (y >= 0 ? 1 : -1);
+        x = folded_x;
+        y = folded_y;
+    }
+    auto quantize = [](double v) {
+        v = v < -1 ? -1 : (v > 1 ? 1 : v);
+        return static_cast<uint16_t>(
+            static_cast<int16_t>(std::lround(v * 32767)));
+    };
+    return static_cast<uint32_t>(quantize(x))
+        | (static_cast<uint32_t>(quantize(y)) << 16);
+}
+
+/**
+ * Unpacks a vector packed by encodeOctahedral().
+ * @param packed The packed vector.
+ * @return The unit vector.
+ */
+inline Vec3 decodeOctahedral(uint32_t packed) {
+    double x = static_cast<int16_t>(packed & 0xffff) / 32767.0;
+    double y = static_cast<int16_t>(packed >> 16) / 32767.0;
+    double z = 1 - std::fabs(x) - std::fabs(y);
+    if (z < 0) {
+        double unfolded_x = (1 - std::fabs(y)) * (x >= 0 ? 1 : -1);
+        double unfolded_y = (1 - std::fabs(x)) * (y >= 0 ? 1 : -1);
+        x = unfolded_x;
+        y = unfolded_y;
+    }
+    return Vec3::normalize(Vec3(x, y, z));
+}
+
+} // namespace rudnick_rt
+
+#endif // RUDNICKRT_OCTAHEDRAL_H
@@ -0,0 +1,89 @@
+/**
+ * @file path_tracer.h
+ * @author Ian Rudnick
+ * Iterative path tracing integrator.
+ * Follows a path bounce by bounce in a loop, carrying the product of every
+ * attenuation so far (the path's throughput) instead of recursing. After a
+ * few bounces, paths are ended at random with Russian roulette, weighted so
+ * the image stays unbiased.
+ *
+ * At every diffuse hit, one light is also sampled directly with a shadow ray
+ * (next-event estimation). Light found that way and light found by a bounced
+ * ray hitting an emitter are both weighted with the power heuristic, so
+ * each is counted once overall (multiple importance sampling).
+ */
+#ifndef RUDNICKRT_PATH_TRACER_H
+#define RUDNICKRT_PATH_TRACER_H
+
+#include "hittable.h"
+#include "light_list.h"
+#include "ray.h"
+#include "sampler.h"
+#include "vec3.h"
+
+namespace rudnick_rt {
+
+class PathTracer {
+public:
+    /**
+     * Constructs a path tracer.
+     * @param background Color of rays that escape the scene.
+     * @param lights Lights to sample directly. With an empty list, light is
+     *               only found by bounced rays hitting an emitter.
+     * @param min_bounces Number of bounces every path gets before Russian
+     *                    roulette can end it.
+     * @param max_bounces Hard limit on the number of bounces in a path.
+     */
+    PathTracer(const RGBColor & background, const LightList & lights,
+               int min_bounces = 3, int max_bounces = 64);
+
+    /**
+     * Traces a path starting from a ray, and finds the light it carries back.
+     * @param ray The ray to start the path from.
+     * @param world The scene to trace the path through.
+     * @param sampler Where to draw the random numbers for each bounce from.
+     * @return The color of the light arriving along the ray.
+     */
+    RGBColor trace(const Ray & ray, const Hittable & world,
+                   Sampler & sampler) const;
+
+    int minBounces() const { return min_bounces_; }
+    int maxBounces() const { return max_bounces_; }
+
+private:
+    /**
+     * Samples one light directly from a hit on a diffuse material.
+     * @param incident The ray that made the hit.
+     * @param record The hit to light.
+     * @param world The scene, to find what the sampled direction reaches.
+     * @param sampler Where to draw the light and the point on it from.
+     * @return The light reflected back along the incident ray, weighted for
+     *         multiple importance sampling.
+     */
+    RGBColor sampleLight(const Ray & incident, const hit_record & record,
+                         const Hittable & world, Sampler & sampler) const;
+
+    /**
+     * Power heuristic weight for a sample from one of two strategies.
+     * @param pdf Density of the strategy the sample came from.
+     * @param other_pdf Density of the other strategy for the same sample.
+     * @return The weight for the sample.
+     */
+    static double powerHeuristic(double pdf, double other_pdf) {
+        return pdf * pdf / (pdf * pdf + other_pdf * other_pdf);
+    }
+
+    RGBColor background_;
+    LightList lights_;
+    int min_bounces_;
+    int max_bounces_;
+
+    // Paths always survive roulette with at most this probability, so a
+    // path bouncing around a perfectly white box still ends eventually.
+    static constexpr double kMaxSurvivalProbability = 0.95;
+
+}; // class PathTracer
+
+} // namespace rudnick_rt
+
+#endif // RUDNICKRT_PATH_TRACER_H
@@ -3,6 +3,9 @@
  * @author Ian Rudnick
  * Simple ray class.
  * Uses Vec3s to represent a point and a direction for the ray.
+ * Also precomputes the data box tests need (inverse direction, direction
+ * signs, and single-precision copies) once when the ray is made, so every
+ * box the ray is tested against can reuse it.
  */
 
 #ifndef RUDNICKRT_RAY_H
@@ -21,6 +24,16 @@ public:
     Ray(const Point3 & origin, const Vec3 & direction)
         : origin_(origin), 
           direction_(direction) {
+        for (int i = 0; i < 3; ++i) {
+            // Nudge zero components off zero so slab tests never multiply
+            // zero by infinity.
+            double d = direction_[i];
+            if (d < 1e-30 && d > -1e-30) d = d < 0 ? -1e-30 : 1e-30;
+            inv_direction_[i] = 1.0 / d;
+            dir_is_neg_[i] = d < 0 ? 1 : 0;
+            origin_f_[i] = static_cast<float>(origin_[i]);
+            inv_direction_f_[i] = static_cast<float>(inv_direction_[i]);
+        }
     }
     
     /* Returns the origin of a Ray. */
@@ -34,10 +47,29 @@ public:
         return origin_ + (t * direction_);
     }
 
+    /* Returns one over each component of the direction. */
+    const Vec3 & invDirection() const { return inv_direction_; }
+
+    /* Returns 1 for each axis the direction points down, and 0 otherwise. */
+    const int * dirIsNeg() const { return dir_is_neg_; }
+
+    /* Returns the origin in single precision, for SIMD box tests. */
+    const float * originF() const { return origin_f_; }
+
+    /* Returns the inverse direction in single precision. */
+    const float * invDirectionF() const { return inv_direction_f_; }
+
 public:
+    // Don't modify these directly; make a new Ray so the data below matches.
     Point3 origin_;
     Vec3 direction_;
 
+private:
+    Vec3 inv_direction_;
+    int dir_is_neg_[3];
+    float origin_f_[3];
+    float inv_direction_f_[3];
+
 }; // class Ray
 
 } // namespace rudnick_rt
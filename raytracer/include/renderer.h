@@ -0,0 +1,228 @@
+/**
+ * @file renderer.h
+ * @author Ian Rudnick
+ * Tile-based multithreaded, progressive renderer.
+ * Splits the image into square tiles and hands them out to the threads in a
+ * ThreadPool. Each thread traces whole tiles.
+ *
+ * The image is traced in passes, at 1, 2, 4, ... samples per pixel, into a
+ * floating-point AccumulationBuffer. So a usable image exists early on, and
+ * gets written out as a snapshot every so often while the render goes on.
+ * With adaptive sampling on, tiles that stop looking noisy drop out of the
+ * passes, so flat, evenly lit parts of the image stop early and the rest of
+ * the time goes to the hard parts.
+ *
+ * The buffer can also be saved to a checkpoint every so often. A render
+ * resumed from a checkpoint ends up with exactly the same image as one that
+ * was never stopped: every sample only depends on its pixel, its index and
+ * the seed, and each tile finishes the pass it was on before deciding
+ * whether it needs more.
+ */
+#ifndef RUDNICKRT_RENDERER_H
+#define RUDNICKRT_RENDERER_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+
+#include "accumulation_buffer.h"
+#include "sampler.h"
+#include "thread_pool.h"
+#include "vec3.h"
+
+namespace rudnick_rt {
+
+class Renderer {
+public:
+    /**
+     * Function that traces one sample of one pixel and returns its color.
+     * Pixel coordinates use the renderer's convention, where (0, 0) is the
+     * lower-left corner of the image.
+     * Called from several threads at once, so it must be thread-safe.
+     * The sampler has already been started on this pixel and sample, and
+     * belongs to the calling thread. The thread's RNG is seeded for the
+     * sample too, for anything that still draws from it.
+     */
+    typedef std::function<RGBColor(int x, int y, Sampler & sampler)>
+        SampleFunction;
+
+    /**
+     * Constructs a renderer for an image of the given size.
+     * Every pixel gets samples_per_pixel samples until adaptive sampling is
+     * turned on with setAdaptive().
+     * @param image_width Width of the image, in pixels.
+     * @param image_height Height of the image, in pixels.
+     * @param samples_per_pixel Number of samples to average for each pixel.
+     *                          With adaptive sampling, the most any pixel
+     *                          gets.
+     * @param tile_size Width and height of each tile, in pixels.
+     * @param seed Seed for the random numbers. Rendering the same scene with
+     *             the same seed gives the same image.
+     */
+    Renderer(int image_width, int image_height, int samples_per_pixel,
+             int tile_size = 16, uint64_t seed = 0);
+
+    /**
+     * Turns on adaptive sampling.
+     * Every tile first gets at least min_samples samples per pixel. After
+     * that, a tile only keeps doubling its samples while its error is above
+     * the threshold, until it reaches samples_per_pixel.
+     * The error of a pixel is how far one standard error of its brightness
+     * moves the value written to the PNG, where 1 is full white. A tile's
+     * error is that of its worst pixel.
+     * @param min_samples Samples every pixel gets before its tile can stop.
+     * @param error_threshold Error a tile has to get below to stop. 0 turns
+     *                        adaptive sampling back off.
+     */
+    void setAdaptive(int min_samples, double error_threshold);
+
+    /**
+     * Limits how long a render can take. Once the time is up, the render
+     * stops after the row of pixels it is on, except to finish the first
+     * pass so that every pixel has a sample. Every finished sample is kept.
+     * @param seconds Wall-clock time limit, in seconds. 0 means no limit.
+     */
+    void setTimeBudget(double seconds) { time_budget_ = seconds; }
+
+    /**
+     * Writes the image in progress to a PNG every so often, so a long render
+     * can be checked on, or stopped once it looks good enough.
+     * @param filename Where to write the PNG. Each snapshot replaces the
+     *                 last one.
+     * @param seconds Time between snapshots. 0 turns snapshots off.
+     */
+    void setSnapshots(const std::string & filename, double seconds) {
+        snapshot_filename_ = filename;
+        snapshot_interval_ = seconds;
+    }
+
+    /**
+     * Saves the buffer to a checkpoint file every so often, and when the
+     * render runs out of time. Once the render finishes, the checkpoint is
+     * deleted, since there is nothing left to resume.
+     * @param filename Where to save the checkpoint.
+     * @param seconds Time between checkpoints. 0 turns checkpoints off.
+     */
+    void setCheckpoints(const std::string & filename, double seconds) {
+        checkpoint_filename_ = filename;
+        checkpoint_interval_ = seconds;
+    }
+
+    /**
+     * Loads the samples from a checkpoint, so that render() carries on from
+     * there. The checkpoint only loads if it was saved by a renderer with
+     * the same settings and the same kind of sampler. Changes to the scene
+     * can't be detected, so delete the checkpoint after changing it.
+     * @param filename The checkpoint to load.
+     * @param sampler The sampler the render will use.
+     * @param film The buffer to load the samples into.
+     * @return False if there was no checkpoint to load, or it didn't match.
+     */
+    bool loadCheckpoint(const std::string & filename, const Sampler & sampler,
+                        AccumulationBuffer & film) const;
+
+    /**
+     * Renders the whole image, adding the samples into a buffer.
+     * Pixels that already have samples in the buffer carry on from where
+     * they were.
+     * Prints the progress to the console as tiles finish.
+     * @param trace The function to trace each sample with.
+     * @param sampler The kind of sampler to use. Each tile gets its own
+     *                clone of it.
+     * @param film The buffer to add the samples to. Must be the image size.
+     * @param pool The threads to render with.
+     * @return The wall-clock time the render took, in seconds.
+     */
+    double render(const SampleFunction & trace, const Sampler & sampler,
+                  AccumulationBuffer & film,
+                  ThreadPool & pool = ThreadPool::global());
+
+    /** @return The number of tiles the image is split into. */
+    int numTiles() const { return tiles_x_ * tiles_y_; }
+
+    /** @return The number of samples traced by the last render. */
+    uint64_t samplesTraced() const { return samples_traced_; }
+
+private:
+    /**
+     * Hashes every setting that changes which samples get traced, to check
+     * checkpoints against.
+     * @param sampler The sampler the render uses.
+     * @return The hash.
+     */
+    uint64_t checkpointKey(const Sampler & sampler) const;
+
+    /**
+     * Traces the next pass of samples for every pixel in one tile.
+     * The tile goes up to twice the samples its emptiest pixel has. Pixels
+     * that are already there, because the tile was stopped partway through
+     * the pass, are left alone.
+     * @param tile Index of the tile, in row-major order.
+     * @param trace The function to trace each sample with.
+     * @param sampler The sampler to draw the samples from.
+     * @param film The buffer to add the samples to. The tile's pixels are
+     *             copied back in while holding film_mutex.
+     * @param film_mutex Lock for writing to the buffer.
+     */
+    void renderTile(int tile, const SampleFunction & trace, Sampler & sampler,
+                    AccumulationBuffer & film, std::mutex & film_mutex) const;
+
+    /**
+     * Checks whether a tile needs another pass.
+     * @param tile Index of the tile, in row-major order.
+     * @param film The samples so far.
+     * @return True if the tile's pixels have different numbers of samples,
+     *         or any pixel is below the minimum samples, or the pixels can
+     *         still get more and the tile's error is above the threshold.
+     */
+    bool needsMoreSamples(int tile, const AccumulationBuffer & film) const;
+
+    /**
+     * Estimates how noisy a tile still is. See setAdaptive().
+     * @param tile Index of the tile, in row-major order.
+     * @param film The samples so far.
+     * @return The largest error of any of the tile's pixels.
+     */
+    double tileError(int tile, const AccumulationBuffer & film) const;
+
+    /**
+     * Gets the pixels a tile covers.
+     */
+    void tileBounds(int tile, int & x0, int & y0, int & x1, int & y1) const;
+
+    /** @return Seconds since the current render started. */
+    double elapsed() const {
+        std::chrono::duration<double> seconds =
+            std::chrono::steady_clock::now() - start_;
+        return seconds.count();
+    }
+
+    /** @return True if the render has used up its time budget. */
+    bool outOfTime() const {
+        return time_budget_ > 0 && elapsed() >= time_budget_;
+    }
+
+    int image_width_;
+    int image_height_;
+    int samples_per_pixel_;
+    int tile_size_;
+    int tiles_x_;
+    int tiles_y_;
+    uint64_t seed_;
+    int min_samples_;
+    double error_threshold_ = 0;
+    double time_budget_ = 0;
+    std::string snapshot_filename_;
+    double snapshot_interval_ = 0;
+    std::string checkpoint_filename_;
+    double checkpoint_interval_ = 0;
+    std::chrono::steady_clock::time_point start_;
+    uint64_t samples_traced_ = 0;
+
+}; // class Renderer
+
+} // namespace rudnick_rt
+
+#endif // RUDNICKRT_RENDERER_H
@@ -0,0 +1,112 @@
+/**
+ * @file rng.h
+ * @author Ian Rudnick
+ * Small, fast pseudo-random number generator for sampling.
+ * Uses Melissa O'Neill's PCG32 (XSH RR variant), which has 16 bytes of
+ * state (an 8-byte position and an 8-byte stream increment) and only needs a
+ * multiply and a few shifts per number.
+ */
+#ifndef RUDNICKRT_RNG_H
+#define RUDNICKRT_RNG_H
+
+#include <cstdint>
+
+namespace rudnick_rt {
+
+class RNG {
+public:
+    /**
+     * Constructs a generator with PCG32's default seed.
+     */
+    constexpr RNG()
+        : state_(0x853c49e6748fea9bULL), inc_(0xda3e39cb94b95bdbULL) {}
+
+    /**
+     * Constructs a generator with the given seed.
+     * @param seed The starting position in the sequence.
+     * @param stream Which of the 2^63 independent sequences to use.
+     */
+    RNG(uint64_t seed, uint64_t stream) { setSeed(seed, stream); }
+
+    /**
+     * Reseeds the generator.
+     * @param seed The starting position in the sequence.
+     * @param stream Which of the 2^63 independent sequences to use.
+     */
+    void setSeed(uint64_t seed, uint64_t stream) {
+        state_ = 0;
+        inc_ = (stream << 1) | 1;
+        nextUInt();
+        state_ += seed;
+        nextUInt();
+    }
+
+    /**
+     * Reseeds the generator for one sample of one pixel, so that a sample
+     * gets the same random numbers no matter which thread traces it or in
+     * what order.
+     * @param pixel Index of the pixel in the image.
+     * @param sample Index of the sample within the pixel.
+     * @param render_seed Seed for the whole render.
+     */
+    void seedSample(uint64_t pixel, uint64_t sample, uint64_t render_seed = 0) {
+        // Every bit of the render seed goes through the hash, so seeds that
+        // only differ in their high bits still give different numbers.
+        setSeed(mix(sample ^ mix(render_seed)), pixel);
+    }
+
+    /**
+     * Generates a uniformly distributed 32-bit integer.
+     * @return A random integer in [0, 2^32).
+     */
+    uint32_t nextUInt() {
+        uint64_t old_state = state_;
+        state_ = old_state * 6364136223846793005ULL + inc_;
+        uint32_t xorshifted =
+            static_cast<uint32_t>(((old_state >> 18u) ^ old_state) >> 27u);
+        uint32_t rot = static_cast<uint32_t>(old_state >> 59u);
+        return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+    }
+
+    /**
+     * Generates a uniformly distributed real number.
+     * @return A random real number in [0, 1).
+     */
+    double nextDouble() {
+        // Multiply by 2^-32, so the largest possible result is still below 1.
+        return nextUInt() * 2.3283064365386963e-10;
+    }
+
+private:
+    /**
+     * Scrambles the bits of a seed, so that nearby seeds (like consecutive
+     * sample indices) start far apart in the sequence.
+     */
+    static uint64_t mix(uint64_t x) {
+        x ^= x >> 31;
+        x *= 0x7fb5d329728ea185ULL;
+        x ^= x >> 27;
+        x *= 0x81dadef4bc2dd44dULL;
+        x ^= x >> 33;
+        return x;
+    }
+
+    uint64_t state_;
+    uint64_t inc_;
+
+}; // class RNG
+
+
+/**
+ * Gets the generator that belongs to the calling thread.
+ * Every thread has its own generator, so there is no shared state to race on.
+ * @return The calling thread's generator.
+ */
+inline RNG & threadRNG() {
+    static thread_local RNG rng;
+    return rng;
+}
+
+} // namespace rudnick_rt
+
+#endif // RUDNICKRT_RNG_H
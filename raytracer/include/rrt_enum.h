@@ -12,6 +12,19 @@ enum class RRTenum {
 	PERSPECTIVE,
 	ORTHOGRAPHIC
 };
+
+/**
+ * How a BVHTree chooses where to split the objects at each node.
+ * MIDPOINT splits at the middle of the centroids' extent.
+ * SAH picks the cheapest split by the Surface Area Heuristic.
+ * LBVH sorts the centroids along a Morton curve and splits where the codes
+ * change. Much faster to build than SAH, but slower to trace.
+ */
+enum class BVHSplitMethod {
+	MIDPOINT,
+	SAH,
+	LBVH
+};
 	
 } // namespace rudnick_rt
 
@@ -0,0 +1,196 @@
+/**
+ * @file sampler.h
+ * @author Ian Rudnick
+ * Samplers hand out the random numbers a path needs, one dimension at a time.
+ * The renderer starts a sampler on each sample of each pixel. Then the
+ * camera, the materials and the lights draw from it in the order they need
+ * numbers: the pixel offset first, then the lens, then each bounce.
+ *
+ * The same dimension of every sample in a pixel forms a point set. A good
+ * sampler spreads those sets out evenly, so each decision along the path is
+ * stratified over the pixel instead of clumping like independent random
+ * numbers do.
+ */
+#ifndef RUDNICKRT_SAMPLER_H
+#define RUDNICKRT_SAMPLER_H
+
+#include <cmath>
+#include <cstdint>
+#include <memory>
+
+#include "rng.h"
+#include "utils.h"
+#include "vec3.h"
+
+namespace rudnick_rt {
+
+/**
+ * A point in the unit square, for drawing two dimensions at once.
+ */
+struct Point2 {
+    double x, y;
+};
+
+
+class Sampler {
+public:
+    virtual ~Sampler() {}
+
+    /**
+     * Starts a new sample, going back to the first dimension.
+     * A sample gets the same numbers no matter which thread traces it or in
+     * what order.
+     * @param pixel Index of the pixel in the image.
+     * @param sample Index of the sample within the pixel.
+     * @param seed Seed for the whole render.
+     */
+    virtual void startSample(uint64_t pixel, uint32_t sample,
+                             uint64_t seed = 0) = 0;
+
+    /**
+     * Draws the next dimension of the current sample.
+     * @return A number in [0, 1).
+     */
+    virtual double get1D() = 0;
+
+    /**
+     * Draws the next two dimensions of the current sample, stratified
+     * together as a pair.
+     * @return A point in [0, 1)^2.
+     */
+    virtual Point2 get2D() = 0;
+
+    /**
+     * Makes a new sampler of the same kind. Samplers keep the state of the
+     * current sample, so each thread needs its own.
+     * @return The new sampler.
+     */
+    virtual std::unique_ptr<Sampler> clone() const = 0;
+
+    /**
+     * @return A name for the kind of sampler, so a saved render can check
+     *         that it gets resumed with the same one.
+     */
+    virtual const char * name() const = 0;
+};
+
+
+/**
+ * Independent uniform random numbers from a PCG32 generator.
+ * No stratification at all; mostly useful as a reference to check the other
+ * samplers against.
+ */
+class RandomSampler : public Sampler {
+public:
+    virtual void startSample(uint64_t pixel, uint32_t sample,
+                             uint64_t seed = 0) override {
+        rng_.seedSample(pixel, sample, seed);
+    }
+
+    virtual double get1D() override { return rng_.nextDouble(); }
+
+    virtual Point2 get2D() override {
+        double x = rng_.nextDouble();
+        return Point2{x, rng_.nextDouble()};
+    }
+
+    virtual std::unique_ptr<Sampler> clone() const override {
+        return std::unique_ptr<Sampler>(new RandomSampler());
+    }
+
+    virtual const char * name() const override { return "random"; }
+
+private:
+    RNG rng_;
+};
+
+
+/**
+ * Owen-scrambled Sobol points, following Burley's "Practical Hash-based Owen
+ * Scrambling" (JCGT 2020).
+ * Every 1D or 2D draw uses the first one or two Sobol dimensions, which form
+ * a (0,2)-sequence: any power-of-two number of samples puts exactly one
+ * point in each of the equal-area boxes it could. Each draw scrambles the
+ * points and shuffles their order with its own hash of the pixel and the
+ * dimension, so pixels and dimensions don't line up with each other.
+ * Works for any sample count, but is best when it is a power of two.
+ */
+class SobolSampler : public Sampler {
+public:
+    virtual void startSample(uint64_t pixel, uint32_t sample,
+                             uint64_t seed = 0) override;
+
+    virtual double get1D() override;
+
+    virtual Point2 get2D() override;
+
+    virtual std::unique_ptr<Sampler> clone() const override {
+        return std::unique_ptr<Sampler>(new SobolSampler());
+    }
+
+    virtual const char * name() const override { return "sobol"; }
+
+private:
+    /**
+     * Gets the seed for the next dimension, and moves on to the one after it.
+     */
+    uint32_t nextDimensionSeed();
+
+    uint64_t pixel_seed_ = 0;
+    uint32_t sample_ = 0;
+    uint32_t dimension_ = 0;
+};
+
+
+/**
+ * Turns a point in the unit square into a point on the unit sphere, keeping
+ * the area uniform.
+ * @param u The point in the unit square.
+ * @return A unit-length vector.
+ */
+inline Vec3 sampleUnitSphere(const Point2 & u) {
+    double z = 1 - 2 * u.x;
+    double r = std::sqrt(std::fmax(0.0, 1 - z*z));
+    double phi = 2 * pi * u.y;
+    return Vec3(r * std::cos(phi), r * std::sin(phi), z);
+}
+
+/**
+ * Turns a point in the unit square and one more number into a point in the
+ * unit ball, keeping the volume uniform.
+ * @param u The point in the unit square, picking the direction.
+ * @param r The number picking the distance from the center.
+ * @return A vector of length at most 1.
+ */
+inline Vec3 sampleUnitBall(const Point2 & u, double r) {
+    return std::cbrt(r) * sampleUnitSphere(u);
+}
+
+/**
+ * Turns a point in the unit square into a point on the unit disc, keeping
+ * the area uniform. Uses Shirley and Chiu's concentric mapping, which keeps
+ * neighboring points together so the stratification carries over.
+ * @param u The point in the unit square.
+ * @return A point on the disc, in the xy-plane.
+ */
+inline Vec3 sampleUnitDisc(const Point2 & u) {
+    double a = 2 * u.x - 1;
+    double b = 2 * u.y - 1;
+    if (a == 0 && b == 0)
+        return Vec3(0, 0, 0);
+
+    double r, theta;
+    if (std::fabs(a) > std::fabs(b)) {
+        r = a;
+        theta = (pi / 4) * (b / a);
+    }
+    else {
+        r = b;
+        theta = (pi / 2) - (pi / 4) * (a / b);
+    }
+    return Vec3(r * std::cos(theta), r * std::sin(theta), 0);
+}
+
+} // namespace rudnick_rt
+
+#endif // RUDNICKRT_SAMPLER_H
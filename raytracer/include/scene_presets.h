@@ -136,21 +136,14 @@ HittableList threeCows()
     auto m_metal = make_shared<BasicMetal>(gray, 0.2);
     auto m_glass = make_shared<BasicLambertian>(white);
 
-    auto diffuse_cow =
-        make_shared<TriangleMesh>("./data/objects/cow.obj", m_diffuse);
-    auto metal_cow =
-        make_shared<TriangleMesh>("./data/objects/cow.obj", m_metal);
-    auto glass_cow =
-        make_shared<TriangleMesh>("./data/objects/cow.obj", m_glass);
-
-    auto translate_metal_cow =
-        make_shared<Translate>(metal_cow, Vec3(0.3, 0, 1.5));
-    auto translate_glass_cow =
-        make_shared<Translate>(glass_cow, Vec3(-0.3, 0, -1.5));
-
-    world.add(diffuse_cow);
-    world.add(translate_metal_cow);
-    world.add(translate_glass_cow);
+    // Load the cow once and place it three times, with a top-level BVH
+    // over the placements.
+    auto cow = TriangleMesh::load("./data/objects/cow.obj");
+    HittableList cows;
+    cows.add(make_shared<MeshInstance>(cow, Vec3(0, 0, 0), m_diffuse));
+    cows.add(make_shared<MeshInstance>(cow, Vec3(0.3, 0, 1.5), m_metal));
+    cows.add(make_shared<MeshInstance>(cow, Vec3(-0.3, 0, -1.5), m_glass));
+    world.add(make_shared<BVHTree>(cows));
 
     return world;
 }
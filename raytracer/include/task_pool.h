@@ -0,0 +1,153 @@
+/**
+ * @file task_pool.h
+ * @author Ian Rudnick
+ * Work-stealing pool of worker threads for recursive, fork-join work.
+ * Unlike ThreadPool::parallelFor, tasks can start more tasks and wait on
+ * them, which suits divide-and-conquer work like building a BVH.
+ *
+ * Each thread keeps its own queue. It runs its newest task first, and steals
+ * the oldest task from another thread's queue when its own runs dry, so
+ * threads mostly steal big pieces of work from near the top of the
+ * recursion. A thread waiting on a TaskGroup runs tasks while it waits.
+ */
+#ifndef RUDNICKRT_TASK_POOL_H
+#define RUDNICKRT_TASK_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace rudnick_rt {
+
+class TaskGroup;
+
+class TaskPool {
+public:
+    /**
+     * Constructs a task pool.
+     * @param num_threads Total number of threads to run tasks on, including
+     *                    threads that wait on a TaskGroup. If this is 0,
+     *                    uses the number of hardware threads.
+     */
+    explicit TaskPool(unsigned num_threads = 0);
+
+    /**
+     * Stops and joins all of the worker threads. Every TaskGroup using the
+     * pool must have finished waiting first.
+     */
+    ~TaskPool();
+
+    TaskPool(const TaskPool &) = delete;
+    TaskPool & operator=(const TaskPool &) = delete;
+
+    /** @return The number of threads tasks are run on. */
+    unsigned size() const { return static_cast<unsigned>(workers_.size()) + 1; }
+
+    /**
+     * Gets a pool shared by the whole program, sized to the hardware.
+     * @return The shared task pool.
+     */
+    static TaskPool & global();
+
+private:
+    friend class TaskGroup;
+
+    struct Task {
+        std::function<void()> work;
+        TaskGroup * group;
+    };
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    /**
+     * Adds a task to the calling thread's queue and wakes a worker.
+     */
+    void push(Task task);
+
+    /**
+     * Runs one task, from the calling thread's queue if it has any, and
+     * stolen from another queue if not.
+     * @return False if there were no tasks to run.
+     */
+    bool runOne();
+
+    /**
+     * Gets the calling thread's queue. Threads outside the pool share
+     * queue 0.
+     */
+    size_t queueIndex() const;
+
+    /**
+     * Loop run by each worker thread. Sleeps when there are no tasks.
+     * @param index The worker's queue.
+     */
+    void workerLoop(size_t index);
+
+    std::vector<std::thread> workers_;
+    std::vector<std::unique_ptr<Queue>> queues_;
+
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+    // Threads blocked in TaskGroup::wait(), woken when a group finishes or
+    // a task is queued.
+    std::condition_variable waiting_;
+    std::atomic<size_t> queued_;
+    bool stopping_;
+
+}; // class TaskPool
+
+
+/**
+ * A set of tasks that can be waited on together.
+ */
+class TaskGroup {
+public:
+    /**
+     * Constructs an empty task group.
+     * @param pool The pool to run the tasks on.
+     */
+    explicit TaskGroup(TaskPool & pool = TaskPool::global())
+        : pool_(pool), pending_(0) {}
+
+    /**
+     * Waits for any tasks still running.
+     */
+    ~TaskGroup() { wait(); }
+
+    TaskGroup(const TaskGroup &) = delete;
+    TaskGroup & operator=(const TaskGroup &) = delete;
+
+    /**
+     * Starts a task. It may run on any thread in the pool, so anything it
+     * touches must stay alive until wait() returns.
+     * @param work The function to run.
+     */
+    void run(std::function<void()> work);
+
+    /**
+     * Blocks until every task started in the group is finished, running
+     * tasks from the pool in the meantime. Sleeps while there are none to
+     * run, rather than spinning.
+     */
+    void wait();
+
+private:
+    friend class TaskPool;
+
+    TaskPool & pool_;
+    std::atomic<size_t> pending_;
+
+}; // class TaskGroup
+
+} // namespace rudnick_rt
+
+#endif // RUDNICKRT_TASK_POOL_H
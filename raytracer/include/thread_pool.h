@@ -0,0 +1,88 @@
+/**
+ * @file thread_pool.h
+ * @author Ian Rudnick
+ * Fixed-size pool of worker threads for parallel loops.
+ * The pool is created once and reused, so starting a parallel loop only
+ * wakes up threads that are already running.
+ */
+#ifndef RUDNICKRT_THREAD_POOL_H
+#define RUDNICKRT_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace rudnick_rt {
+
+class ThreadPool {
+public:
+    /**
+     * Constructs a thread pool.
+     * @param num_threads Total number of threads to run loops on, including
+     *                    the thread that calls parallelFor(). If this is 0,
+     *                    uses the number of hardware threads.
+     */
+    explicit ThreadPool(unsigned num_threads = 0);
+
+    /**
+     * Stops and joins all of the worker threads.
+     */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool & operator=(const ThreadPool &) = delete;
+
+    /** @return The number of threads loops are run on. */
+    unsigned size() const { return static_cast<unsigned>(workers_.size()) + 1; }
+
+    /**
+     * Runs body(i) for every i in [0, count), spread over all the threads in
+     * the pool. Indices are handed out one at a time, so each call should do
+     * a decent chunk of work (a tile, not a pixel). Blocks until every index
+     * is finished. The calling thread works on the loop too.
+     * Only one loop can run on a pool at a time, so don't call this from
+     * inside a loop body.
+     * @param count The number of loop iterations.
+     * @param body The function to call for each iteration.
+     */
+    void parallelFor(size_t count, const std::function<void(size_t)> & body);
+
+    /**
+     * Gets a pool shared by the whole program, sized to the hardware.
+     * @return The shared thread pool.
+     */
+    static ThreadPool & global();
+
+private:
+    /**
+     * Loop run by each worker thread. Sleeps until a job is posted.
+     */
+    void workerLoop();
+
+    /**
+     * Pulls indices from the current job until there are none left.
+     */
+    void runJob();
+
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable job_ready_;
+    std::condition_variable job_done_;
+
+    // State of the job currently being run
+    const std::function<void(size_t)> * body_;
+    size_t count_;
+    std::atomic<size_t> next_index_;
+    unsigned active_workers_;
+    unsigned long generation_;
+    bool stopping_;
+
+}; // class ThreadPool
+
+} // namespace rudnick_rt
+
+#endif // RUDNICKRT_THREAD_POOL_H
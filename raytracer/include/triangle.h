@@ -56,6 +56,12 @@ public:
     virtual bool hit(const Ray & ray, double tmin, double tmax, 
 					 hit_record & record) const override;
 
+	virtual void surfaceDetails(const Ray & ray,
+								hit_record & record) const override;
+
+	virtual bool occluded(const Ray & ray, double tmin,
+						  double tmax) const override;
+
 	virtual bool boundingBox(AABB& output) const override;
 
 private:
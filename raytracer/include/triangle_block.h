@@ -0,0 +1,199 @@
+/**
+ * @file triangle_block.h
+ * @author Ian Rudnick
+ * Four triangles packed for intersecting all at once.
+ * Each triangle is stored as a vertex and its two edges, precomputed in
+ * single precision and laid out structure-of-arrays, so one SSE
+ * Möller–Trumbore test checks the ray against all four.
+ */
+#ifndef RUDNICKRT_TRIANGLE_BLOCK_H
+#define RUDNICKRT_TRIANGLE_BLOCK_H
+
+#include <cfloat>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#include "ray.h"
+#include "vec3.h"
+
+namespace rudnick_rt {
+
+/**
+ * One block of four triangles, one axis per row and one triangle per column.
+ * Unused columns are left as zeros, which no ray can hit.
+ */
+struct alignas(16) TriangleBlock {
+    float v0[3][4];
+    float e1[3][4];
+    float e2[3][4];
+
+    /**
+     * Stores a triangle in one column of the block.
+     * @param lane Column to store the triangle in, from 0 to 3.
+     * @param p0 First vertex of the triangle.
+     * @param p1 Second vertex of the triangle.
+     * @param p2 Third vertex of the triangle.
+     */
+    void set(int lane, const Point3 & p0, const Point3 & p1,
+             const Point3 & p2) {
+        for (int i = 0; i < 3; ++i) {
+            v0[i][lane] = static_cast<float>(p0[i]);
+            e1[i][lane] = static_cast<float>(p1[i] - p0[i]);
+            e2[i][lane] = static_cast<float>(p2[i] - p0[i]);
+        }
+    }
+
+    /**
+     * Finds the closest of the four triangles a ray hits.
+     * @param ray The ray to test.
+     * @param tmin The minimum distance along the ray to detect a hit.
+     * @param tmax The maximum distance along the ray to detect a hit.
+     * @param t Output for the distance to the closest hit.
+     * @param u Output for the first barycentric coordinate of the hit.
+     * @param v Output for the second barycentric coordinate of the hit.
+     * @return Column of the closest triangle hit, or -1 if none were.
+     */
+    int hit(const Ray & ray, float tmin, float tmax,
+            float & t, float & u, float & v) const;
+
+    /**
+     * Checks whether a ray hits any of the four triangles.
+     * @param ray The ray to test.
+     * @param tmin The minimum distance along the ray to detect a hit.
+     * @param tmax The maximum distance along the ray to detect a hit.
+     * @return True if any triangle is hit between tmin and tmax.
+     */
+    bool occluded(const Ray & ray, float tmin, float tmax) const {
+        float t, u, v;
+        return hit(ray, tmin, tmax, t, u, v) >= 0;
+    }
+};
+
+static_assert(sizeof(TriangleBlock) == 144, "TriangleBlock must be 144 bytes");
+
+
+inline int TriangleBlock::hit(const Ray & ray, float tmin, float tmax,
+                              float & t, float & u, float & v) const {
+    // Same determinant cutoff as Triangle::hit.
+    const float epsilon = 0.00001f;
+    const float * origin = ray.originF();
+    float dir[3] = {
+        static_cast<float>(ray.direction().x()),
+        static_cast<float>(ray.direction().y()),
+        static_cast<float>(ray.direction().z())
+    };
+#ifdef __SSE__
+    __m128 dx = _mm_set1_ps(dir[0]);
+    __m128 dy = _mm_set1_ps(dir[1]);
+    __m128 dz = _mm_set1_ps(dir[2]);
+    __m128 e1x = _mm_load_ps(e1[0]);
+    __m128 e1y = _mm_load_ps(e1[1]);
+    __m128 e1z = _mm_load_ps(e1[2]);
+    __m128 e2x = _mm_load_ps(e2[0]);
+    __m128 e2y = _mm_load_ps(e2[1]);
+    __m128 e2z = _mm_load_ps(e2[2]);
+
+    // q = dir x e2, a = e1 . q
+    __m128 qx = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+    __m128 qy = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+    __m128 qz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+    __m128 a = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, qx), _mm_mul_ps(e1y, qy)),
+                          _mm_mul_ps(e1z, qz));
+
+    // Rays parallel to a triangle miss it. Those lanes divide by 1 instead,
+    // so nothing downstream turns into NaN.
+    __m128 valid = _mm_or_ps(_mm_cmpgt_ps(a, _mm_set1_ps(epsilon)),
+                             _mm_cmplt_ps(a, _mm_set1_ps(-epsilon)));
+    a = _mm_or_ps(_mm_and_ps(valid, a),
+                  _mm_andnot_ps(valid, _mm_set1_ps(1.0f)));
+    __m128 f = _mm_div_ps(_mm_set1_ps(1.0f), a);
+
+    // s = origin - v0, u = f * (s . q)
+    __m128 sx = _mm_sub_ps(_mm_set1_ps(origin[0]), _mm_load_ps(v0[0]));
+    __m128 sy = _mm_sub_ps(_mm_set1_ps(origin[1]), _mm_load_ps(v0[1]));
+    __m128 sz = _mm_sub_ps(_mm_set1_ps(origin[2]), _mm_load_ps(v0[2]));
+    __m128 u4 = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(
+        _mm_mul_ps(sx, qx), _mm_mul_ps(sy, qy)), _mm_mul_ps(sz, qz)));
+
+    // r = s x e1, v = f * (dir . r), t = f * (e2 . r)
+    __m128 rx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+    __m128 ry = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+    __m128 rz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+    __m128 v4 = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(
+        _mm_mul_ps(dx, rx), _mm_mul_ps(dy, ry)), _mm_mul_ps(dz, rz)));
+    __m128 t4 = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(
+        _mm_mul_ps(e2x, rx), _mm_mul_ps(e2y, ry)), _mm_mul_ps(e2z, rz)));
+
+    __m128 zero = _mm_setzero_ps();
+    valid = _mm_and_ps(valid, _mm_cmpge_ps(u4, zero));
+    valid = _mm_and_ps(valid, _mm_cmpge_ps(v4, zero));
+    valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(u4, v4),
+                                           _mm_set1_ps(1.0f)));
+    valid = _mm_and_ps(valid, _mm_cmpge_ps(t4, _mm_set1_ps(tmin)));
+    valid = _mm_and_ps(valid, _mm_cmpgt_ps(t4, _mm_set1_ps(epsilon)));
+    valid = _mm_and_ps(valid, _mm_cmple_ps(t4, _mm_set1_ps(tmax)));
+    int mask = _mm_movemask_ps(valid);
+    if (mask == 0) return -1;
+
+    // Find the smallest t among the lanes that hit.
+    __m128 t_hit = _mm_or_ps(_mm_and_ps(valid, t4),
+                             _mm_andnot_ps(valid, _mm_set1_ps(FLT_MAX)));
+    __m128 t_min = _mm_min_ps(t_hit,
+        _mm_shuffle_ps(t_hit, t_hit, _MM_SHUFFLE(2, 3, 0, 1)));
+    t_min = _mm_min_ps(t_min,
+        _mm_shuffle_ps(t_min, t_min, _MM_SHUFFLE(1, 0, 3, 2)));
+    mask &= _mm_movemask_ps(_mm_cmpeq_ps(t_hit, t_min));
+
+    int lane = 0;
+    while (!(mask & (1 << lane))) ++lane;
+
+    float t_lanes[4], u_lanes[4], v_lanes[4];
+    _mm_storeu_ps(t_lanes, t4);
+    _mm_storeu_ps(u_lanes, u4);
+    _mm_storeu_ps(v_lanes, v4);
+    t = t_lanes[lane];
+    u = u_lanes[lane];
+    v = v_lanes[lane];
+    return lane;
+#else
+    int closest = -1;
+    for (int c = 0; c < 4; ++c) {
+        float qx = dir[1] * e2[2][c] - dir[2] * e2[1][c];
+        float qy = dir[2] * e2[0][c] - dir[0] * e2[2][c];
+        float qz = dir[0] * e2[1][c] - dir[1] * e2[0][c];
+        float a = e1[0][c] * qx + e1[1][c] * qy + e1[2][c] * qz;
+        if (a > -epsilon && a < epsilon) continue;
+
+        float f = 1.0f / a;
+        float sx = origin[0] - v0[0][c];
+        float sy = origin[1] - v0[1][c];
+        float sz = origin[2] - v0[2][c];
+        float u_c = f * (sx * qx + sy * qy + sz * qz);
+        if (u_c < 0.0f || u_c > 1.0f) continue;
+
+        float rx = sy * e1[2][c] - sz * e1[1][c];
+        float ry = sz * e1[0][c] - sx * e1[2][c];
+        float rz = sx * e1[1][c] - sy * e1[0][c];
+        float v_c = f * (dir[0] * rx + dir[1] * ry + dir[2] * rz);
+        if (v_c < 0.0f || u_c + v_c > 1.0f) continue;
+
+        float t_c = f * (e2[0][c] * rx + e2[1][c] * ry + e2[2][c] * rz);
+        if (t_c < tmin || t_c <= epsilon || t_c > tmax) continue;
+
+        // On a tie keep the lowest lane, to match the SSE path.
+        if (closest < 0 || t_c < t) {
+            t = t_c;
+            u = u_c;
+            v = v_c;
+            closest = c;
+        }
+    }
+    return closest;
+#endif
+}
+
+} // namespace rudnick_rt
+
+#endif // RUDNICKRT_TRIANGLE_BLOCK_H
@@ -2,19 +2,44 @@
  * @file triangle_mesh.h
  * @author Ian Rudnick
  * @brief Class representing a triangulated mesh. Can be loaded in from an OBJ
- * file. Derived from the Hittable class.
+ * file or a binary mesh file. Derived from the Hittable class.
+ *
+ * The mesh is stored as shared buffers instead of one Triangle object per
+ * face: one position and one normal per vertex, three 32-bit vertex indices
+ * per triangle, and one material for the whole mesh. Normals are packed into
+ * 32 bits each with an octahedral mapping. Its BVH leaves refer to
+ * triangles by index.
+ *
+ * For intersection, the triangles are also packed four at a time into
+ * TriangleBlocks. Every leaf starts on a block boundary, so a leaf is tested
+ * a whole block at a time.
+ *
+ * Binary mesh files (.rmesh) hold the same buffers, laid out so they can be
+ * used straight out of a memory mapped file without copying. They can also
+ * hold the built BVH and blocks, in which case loading does no work at all.
+ * Make them from OBJ files with the obj2rmesh tool.
+ *
+ * Building the BVH is slow for big meshes, so a mesh built from an OBJ file
+ * is also saved next to it as a binary mesh, filename.obj.bvhcache. The
+ * cache is keyed by a hash of the OBJ file and the build settings, and later
+ * runs map it in instead of building. Changing the file or the settings
+ * rebuilds it.
  */
 #ifndef RUDNICKRT_TRIANGLE_MESH_H
 #define RUDNICKRT_TRIANGLE_MESH_H
 
+#include <cstdint>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "aabb.h"
-#include "bvh_tree.h"
 #include "hittable.h"
-#include "hittable_list.h"
-#include "triangle.h"
+#include "mapped_file.h"
+#include "material.h"
+#include "octahedral.h"
+#include "triangle_block.h"
+#include "wide_bvh.h"
 
 namespace rudnick_rt {
 
@@ -27,18 +52,129 @@ public:
 	TriangleMesh() {}
 
 	/**
-	 * Constructs a TriangleMesh from an OBJ file.
-	 * @param filename Name of the .obj file containing the mesh.
+	 * Constructs a TriangleMesh from an OBJ file or a binary mesh file.
+	 * Files ending in .rmesh are loaded as binary meshes.
+	 * @param filename Name of the .obj or .rmesh file containing the mesh.
+	 * @param mat Material the whole mesh is made of.
+	 * @param use_cache Whether to load and save the cache next to an OBJ
+	 *                  file.
+	 */
+	TriangleMesh(const std::string& filename, std::shared_ptr<Material> mat,
+				 bool use_cache = true);
+
+	TriangleMesh(const TriangleMesh&) = delete;
+	TriangleMesh& operator=(const TriangleMesh&) = delete;
+
+	/**
+	 * Loads a mesh to be placed in the scene with MeshInstances. Every call
+	 * with the same file shares one mesh, so the file is only parsed and its
+	 * BVH only built once, however many times it's placed. The mesh has no
+	 * material of its own, so its instances must give it one.
+	 * @param filename Name of the .obj or .rmesh file containing the mesh.
+	 * @return The shared mesh.
+	 */
+	static std::shared_ptr<const TriangleMesh> load(const std::string& filename);
+
+	/**
+	 * Saves the mesh as a binary mesh file.
+	 * @param path Name of the file to write.
+	 * @param include_bvh Whether to save the built BVH too. Without it the
+	 *                    file is smaller, but the BVH is built every time
+	 *                    the file is loaded.
+	 * @return False if the file couldn't be written.
 	 */
-	TriangleMesh(const std::string& filename, std::shared_ptr<Material> mat);
+	bool save(const std::string& path, bool include_bvh = true) const;
 
-	virtual bool hit(const Ray & ray, double tmin, double tmax, 
+	virtual bool hit(const Ray & ray, double tmin, double tmax,
 					 hit_record & record) const override;
 
+	virtual void surfaceDetails(const Ray & ray,
+								hit_record & record) const override;
+
+	virtual bool occluded(const Ray & ray, double tmin,
+						  double tmax) const override;
+
 	virtual bool boundingBox(AABB& output) const override;
 
+	/** @return The number of triangles in the mesh. */
+	size_t numTriangles() const { return num_triangles_; }
+
+	/** @return The number of vertices in the mesh. */
+	size_t numVertices() const { return num_vertices_; }
+
 private:
-	std::shared_ptr<BVHTree> mesh_;
+	/**
+	 * Loads the mesh from an OBJ file and builds its BVH.
+	 * @param filename Name of the .obj file containing the mesh.
+	 * @return False if the file couldn't be loaded.
+	 */
+	bool loadObj(const std::string& filename);
+
+	/**
+	 * Loads the mesh from a binary mesh file, using its buffers in place.
+	 * Builds the BVH if the file doesn't have one.
+	 * @param path Name of the binary mesh file.
+	 * @param key If not null, the hash the file must have been saved with.
+	 * Every vertex index, child node and leaf range in the file is checked
+	 * before it's used.
+	 * @return False if the file is missing or damaged, is an older version,
+	 *         or doesn't match the key.
+	 */
+	bool loadBinary(const std::string& path, const uint64_t * key);
+
+	/**
+	 * Builds the BVH and blocks, and puts the triangles in leaf order.
+	 * The positions must already be set.
+	 * @param indices Three vertex indices per triangle, in any order.
+	 */
+	void buildBVH(const std::vector<uint32_t>& indices);
+
+	/**
+	 * Gets a vertex position from the position buffer.
+	 * @param vertex Index of the vertex.
+	 * @return The vertex position.
+	 */
+	Point3 position(uint32_t vertex) const {
+		return Point3(positions_[3*vertex + 0],
+					  positions_[3*vertex + 1],
+					  positions_[3*vertex + 2]);
+	}
+
+	/**
+	 * Gets a vertex normal from the normal buffer.
+	 * @param vertex Index of the vertex.
+	 * @return The vertex normal.
+	 */
+	Vec3 normal(uint32_t vertex) const {
+		return decodeOctahedral(normals_[vertex]);
+	}
+
+	// The mesh's buffers. They point into the storage below for a mesh
+	// built here, or straight into the mapped file for a binary mesh.
+	// xyz of each vertex position
+	const float * positions_ = nullptr;
+	// Octahedral packed normal of each vertex
+	const uint32_t * normals_ = nullptr;
+	// Three vertex indices per triangle, in the BVH's leaf order. Padding
+	// between leaves points at vertex 0.
+	const uint32_t * indices_ = nullptr;
+	// The same triangles as indices_, four to a block.
+	const TriangleBlock * blocks_ = nullptr;
+	size_t num_vertices_ = 0;
+	size_t num_triangles_ = 0;
+	// Triangles plus padding
+	size_t num_slots_ = 0;
+	WideBVH bvh_;
+
+	std::vector<float> position_storage_;
+	std::vector<uint32_t> normal_storage_;
+	std::vector<uint32_t> index_storage_;
+	std::vector<TriangleBlock> block_storage_;
+	std::unique_ptr<MappedFile> file_;
+
+	// Hash of the OBJ file the mesh came from, or 0 if there wasn't one.
+	uint64_t key_ = 0;
+	std::shared_ptr<Material> material_;
 };
 
 }
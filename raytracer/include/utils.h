@@ -10,7 +10,8 @@
 #include <cmath>
 #include <limits>
 #include <memory>
-#include <random>
+
+#include "rng.h"
 
 using std::shared_ptr;
 using std::make_shared;
@@ -47,12 +48,13 @@ inline double clamp(double x, double min, double max) {
 
 /**
  * Generates a pseudo-random number.
+ * Draws from the calling thread's generator, so this is safe to call while
+ * rendering on multiple threads. Seed it with threadRNG().seedSample() to
+ * make a sample reproducible.
  * @return A random real number in [0, 1).
  */
 inline double randomDouble() {
-    static std::uniform_real_distribution<double> distribution(0.0, 1.0);
-    static std::mt19937 generator;
-    return distribution(generator);
+    return threadRNG().nextDouble();
 }
 
 /**
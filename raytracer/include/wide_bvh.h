@@ -0,0 +1,326 @@
+/**
+ * @file wide_bvh.h
+ * @author Ian Rudnick
+ * 4-wide Bounding Volume Hierarchy for fast traversal.
+ * Made by collapsing a binary LinearBVH so each node holds up to four
+ * children. The children's boxes are stored structure-of-arrays, so one SSE
+ * slab test checks the ray against all four at once, using the single
+ * precision copies the Ray keeps.
+ *
+ * The nodes are usually owned by the BVH, but it can also traverse nodes it
+ * doesn't own, such as ones in a memory mapped file.
+ */
+#ifndef RUDNICKRT_WIDE_BVH_H
+#define RUDNICKRT_WIDE_BVH_H
+
+#include <cfloat>
+#include <cstdint>
+#include <vector>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#include "aabb.h"
+#include "linear_bvh.h"
+#include "ray.h"
+#include "vec3.h"
+
+namespace rudnick_rt {
+
+/**
+ * One node of a WideBVH. Exactly two cache lines.
+ * bounds[0] holds the children's min corners and bounds[1] their max
+ * corners, one axis per row and one child per column.
+ */
+struct alignas(16) WideBVHNode {
+    float bounds[2][3][4];
+    // Index of a child node, or of the first primitive for leaf children.
+    uint32_t child[4];
+    // Number of primitives for leaf children, 0 for node children.
+    uint32_t num_primitives[4];
+
+    /**
+     * Checks whether a child slot is unused. Unused slots point back at the
+     * root, with a box from FLT_MAX to -FLT_MAX on every axis that no ray
+     * can hit.
+     */
+    bool isEmpty(int c) const {
+        if (child[c] != 0 || num_primitives[c] != 0) return false;
+        for (int i = 0; i < 3; ++i) {
+            if (bounds[0][i][c] != FLT_MAX || bounds[1][i][c] != -FLT_MAX)
+                return false;
+        }
+        return true;
+    }
+};
+
+static_assert(sizeof(WideBVHNode) == 128, "WideBVHNode must be 128 bytes");
+
+
+class WideBVH {
+public:
+    // Deepest a tree can be, counting the root as depth 1. A built tree is
+    // no deeper than the binary one it's collapsed from.
+    static const int kMaxDepth = LinearBVH::kMaxDepth;
+
+    /**
+     * Constructs an empty BVH that nothing can hit.
+     */
+    WideBVH() : root_(nullptr), num_nodes_(0) {}
+
+    /**
+     * Copies a BVH. A copy of a BVH that owns its nodes owns a copy of
+     * them, and a copy of a view is another view of the same nodes.
+     */
+    WideBVH(const WideBVH & other);
+    WideBVH & operator=(const WideBVH & other);
+
+    /**
+     * Builds the wide BVH by collapsing a binary one. Leaves keep the same
+     * primitive ranges, so the primitive order from the LinearBVH still
+     * applies.
+     * @param bvh The binary BVH to collapse.
+     */
+    void build(const LinearBVH & bvh);
+
+    /**
+     * Walks the BVH with a ray, calling a function on every leaf whose box
+     * the ray hits, nearest first.
+     * @param ray The ray to trace.
+     * @param tmin The minimum distance along the ray to detect a hit.
+     * @param tmax The maximum distance along the ray to detect a hit.
+     * @param hit_leaf Function with the signature
+     *                 bool(uint32_t first, uint32_t count, double & tmax).
+     *                 It should check primitives [first, first + count),
+     *                 lower tmax to the closest hit, and return true if there
+     *                 was one.
+     * @return True if any leaf reported a hit.
+     */
+    template <typename LeafFunction>
+    bool traverse(const Ray & ray, double tmin, double tmax,
+                  LeafFunction hit_leaf) const;
+
+    /**
+     * Walks the BVH with a ray until some leaf reports a hit. Leaves are
+     * visited in no particular order.
+     * @param ray The ray to trace.
+     * @param tmin The minimum distance along the ray to detect a hit.
+     * @param tmax The maximum distance along the ray to detect a hit.
+     * @param hit_leaf Function with the signature
+     *                 bool(uint32_t first, uint32_t count).
+     *                 It should return true if any of primitives
+     *                 [first, first + count) is hit between tmin and tmax.
+     * @return True if any leaf reported a hit.
+     */
+    template <typename LeafFunction>
+    bool occluded(const Ray & ray, double tmin, double tmax,
+                  LeafFunction hit_leaf) const;
+
+    /**
+     * Gets the bounding box of everything in the BVH.
+     * @param box Output to store the bounding box.
+     * @return True if the BVH is not empty.
+     */
+    bool boundingBox(AABB & box) const;
+
+    /** @return The number of nodes in the BVH. */
+    size_t numNodes() const { return num_nodes_; }
+
+    /** @return The nodes of the BVH, root first. */
+    const WideBVHNode * nodes() const { return root_; }
+
+    /**
+     * Replaces the BVH with a view of nodes saved from another one, such as
+     * ones in a memory mapped file. The nodes aren't copied, so they must
+     * outlive the BVH.
+     * @param nodes The saved nodes, root first.
+     * @param count The number of nodes.
+     * @param bounds Bounding box of everything in the BVH.
+     */
+    void view(const WideBVHNode * nodes, size_t count, const AABB & bounds);
+
+private:
+    /**
+     * Tests a ray against the four child boxes of a node.
+     * @param node The node to test.
+     * @param ray The ray to test.
+     * @param tmin The minimum distance along the ray to detect a hit.
+     * @param tmax The maximum distance along the ray to detect a hit.
+     * @param tnear Output for the distance each box is entered at.
+     * @return Bit mask with bit i set if the ray hits child i.
+     */
+    static int hitChildren(const WideBVHNode & node, const Ray & ray,
+                           float tmin, float tmax, float tnear[4]);
+
+    /**
+     * Recursively collapses a binary subtree into wide nodes.
+     * @param binary The binary BVH's nodes.
+     * @param index Index of the binary node to collapse.
+     * @return Index of the wide node made for it.
+     */
+    uint32_t collapse(const std::vector<LinearBVHNode> & binary,
+                      uint32_t index);
+
+    // Nodes built by this BVH. Empty when it's a view of someone else's.
+    std::vector<WideBVHNode> nodes_;
+    // The nodes traversal uses, from nodes_ or from a view.
+    const WideBVHNode * root_;
+    size_t num_nodes_;
+    AABB bounds_;
+
+    // Pads the far distance of each slab test, so float rounding can't make
+    // a ray miss a box it grazes. This is 1 + 2 * gamma(3) from PBRT.
+    static constexpr float kRobustFactor = 1.0f + 2.0f * 3.0f * FLT_EPSILON;
+
+    // Stack size for traversal. Each node pushes at most three more entries
+    // than it pops.
+    static const int kStackSize = 3 * kMaxDepth + 4;
+
+}; // class WideBVH
+
+
+inline int WideBVH::hitChildren(const WideBVHNode & node, const Ray & ray,
+                                float tmin, float tmax, float tnear[4]) {
+    const float * ray_origin = ray.originF();
+    const float * ray_inv_dir = ray.invDirectionF();
+    const int * dir_is_neg = ray.dirIsNeg();
+#ifdef __SSE__
+    __m128 t_enter = _mm_set1_ps(tmin);
+    __m128 t_exit = _mm_set1_ps(tmax);
+    for (int i = 0; i < 3; ++i) {
+        // Test the near plane and far plane of each slab, picked by the
+        // ray's direction so no min/max swap is needed.
+        __m128 origin = _mm_set1_ps(ray_origin[i]);
+        __m128 inv_dir = _mm_set1_ps(ray_inv_dir[i]);
+        __m128 near_plane = _mm_load_ps(node.bounds[dir_is_neg[i]][i]);
+        __m128 far_plane = _mm_load_ps(node.bounds[1 - dir_is_neg[i]][i]);
+        __m128 t0 = _mm_mul_ps(_mm_sub_ps(near_plane, origin), inv_dir);
+        __m128 t1 = _mm_mul_ps(_mm_sub_ps(far_plane, origin), inv_dir);
+        t_enter = _mm_max_ps(t_enter, t0);
+        t_exit = _mm_min_ps(t_exit, _mm_mul_ps(t1, _mm_set1_ps(kRobustFactor)));
+    }
+    _mm_storeu_ps(tnear, t_enter);
+    return _mm_movemask_ps(_mm_cmple_ps(t_enter, t_exit));
+#else
+    int mask = 0;
+    for (int c = 0; c < 4; ++c) {
+        float t_enter = tmin;
+        float t_exit = tmax;
+        for (int i = 0; i < 3; ++i) {
+            float near_plane = node.bounds[dir_is_neg[i]][i][c];
+            float far_plane = node.bounds[1 - dir_is_neg[i]][i][c];
+            float t0 = (near_plane - ray_origin[i]) * ray_inv_dir[i];
+            float t1 = (far_plane - ray_origin[i]) * ray_inv_dir[i];
+            t_enter = t0 > t_enter ? t0 : t_enter;
+            t1 *= kRobustFactor;
+            t_exit = t1 < t_exit ? t1 : t_exit;
+        }
+        tnear[c] = t_enter;
+        if (t_enter <= t_exit) mask |= 1 << c;
+    }
+    return mask;
+#endif
+}
+
+
+template <typename LeafFunction>
+bool WideBVH::traverse(const Ray & ray, double tmin, double tmax,
+                       LeafFunction hit_leaf) const {
+    if (num_nodes_ == 0) return false;
+
+    float tmin_f = static_cast<float>(tmin);
+
+    // Children still to visit, along with the distance they're entered at.
+    struct StackEntry {
+        uint32_t child;
+        uint32_t num_primitives;
+        float tnear;
+    };
+    StackEntry stack[kStackSize];
+    int stack_size = 0;
+    stack[stack_size++] = {0, 0, tmin_f};
+
+    bool hit_anything = false;
+    while (stack_size > 0) {
+        StackEntry entry = stack[--stack_size];
+        float tmax_f = tmax < FLT_MAX ? static_cast<float>(tmax) : FLT_MAX;
+
+        // Skip anything that's now behind the closest hit.
+        if (entry.tnear > tmax_f) continue;
+
+        if (entry.num_primitives > 0) {
+            if (hit_leaf(entry.child, entry.num_primitives, tmax)) {
+                hit_anything = true;
+            }
+            continue;
+        }
+
+        const WideBVHNode & node = root_[entry.child];
+        float tnear[4];
+        int mask = hitChildren(node, ray, tmin_f, tmax_f, tnear);
+
+        // Push the children that were hit, farthest first, so the nearest
+        // one is popped next.
+        int first = stack_size;
+        for (int c = 0; c < 4; ++c) {
+            if (!(mask & (1 << c))) continue;
+            // Only a tree deeper than kMaxDepth can fill the stack. Skip
+            // the rest of it rather than write past the end.
+            if (stack_size == kStackSize) break;
+            StackEntry child = {node.child[c], node.num_primitives[c], tnear[c]};
+            int j = stack_size++;
+            while (j > first && stack[j - 1].tnear < child.tnear) {
+                stack[j] = stack[j - 1];
+                --j;
+            }
+            stack[j] = child;
+        }
+    }
+    return hit_anything;
+}
+
+
+template <typename LeafFunction>
+bool WideBVH::occluded(const Ray & ray, double tmin, double tmax,
+                       LeafFunction hit_leaf) const {
+    if (num_nodes_ == 0) return false;
+
+    float tmin_f = static_cast<float>(tmin);
+    float tmax_f = tmax < FLT_MAX ? static_cast<float>(tmax) : FLT_MAX;
+
+    // Any hit will do, so there's no need to sort the children. The stack
+    // only needs the child and its primitive count.
+    uint32_t stack[kStackSize][2];
+    int stack_size = 0;
+    stack[stack_size][0] = 0;
+    stack[stack_size][1] = 0;
+    ++stack_size;
+
+    while (stack_size > 0) {
+        --stack_size;
+        uint32_t child = stack[stack_size][0];
+        uint32_t num_primitives = stack[stack_size][1];
+
+        if (num_primitives > 0) {
+            if (hit_leaf(child, num_primitives)) return true;
+            continue;
+        }
+
+        const WideBVHNode & node = root_[child];
+        float tnear[4];
+        int mask = hitChildren(node, ray, tmin_f, tmax_f, tnear);
+        for (int c = 0; c < 4; ++c) {
+            if (!(mask & (1 << c))) continue;
+            if (stack_size == kStackSize) break;
+            stack[stack_size][0] = node.child[c];
+            stack[stack_size][1] = node.num_primitives[c];
+            ++stack_size;
+        }
+    }
+    return false;
+}
+
+} // namespace rudnick_rt
+
+#endif // RUDNICKRT_WIDE_BVH_H
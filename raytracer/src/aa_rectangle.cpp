@@ -1,13 +1,46 @@
 #include "aa_rectangle.h"
 
+#include <cmath>
+#include <vector>
+
 #include "aabb.h"
 #include "hittable.h"
 #include "material.h"
 #include "ray.h"
+#include "sampler.h"
 #include "utils.h"
 #include "vec3.h"
 
 namespace rudnick_rt {
+
+namespace {
+
+/**
+ * Gets the solid angle density of picking a direction towards a rectangle,
+ * when points on the rectangle are picked uniformly by area.
+ * @param rect The rectangle.
+ * @param area The rectangle's area.
+ * @param origin The point the direction starts from.
+ * @param direction The direction to get the density of.
+ * @return The density, or 0 if the direction misses the rectangle.
+ */
+double rectanglePdf(const Hittable & rect, double area, const Point3 & origin,
+                    const Vec3 & direction) {
+    hit_record record;
+    if (!rect.hitSurface(Ray(origin, direction), 0.001, infinity, record))
+        return 0;
+
+    // Convert the density from area to solid angle.
+    auto distance_squared = record.t * record.t * direction.lengthSquared();
+    auto cosine = std::fabs(Vec3::dot(direction, record.normal))
+                / direction.length();
+    if (cosine <= 0)
+        return 0;
+    return distance_squared / (cosine * area);
+}
+
+} // namespace
+
 //-----------------------------------------------------------------------------
 // X - Y (wall)
 bool XYRect::hit(const Ray& ray, double tmin, double tmax, hit_record& record) const {
@@ -22,11 +55,24 @@ bool XYRect::hit(const Ray& ray, double tmin, double tmax, hit_record& record) c
     record.u = (x-x0_) / (x1_-x0_);
     record.v = (y-y0_) / (y1_-y0_);
     record.t = t;
+    record.object = this;
+    return true;
+}
+
+void XYRect::surfaceDetails(const Ray& ray, hit_record& record) const {
     auto outward_normal = Vec3(0, 0, 1);
     record.setNormalDirection(ray, outward_normal);
-    record.material = m_;
-    record.point = ray.at(t);
-    return true;
+    record.material = m_.get();
+    record.point = ray.at(record.t);
+}
+
+bool XYRect::occluded(const Ray& ray, double tmin, double tmax) const {
+    auto t = (k_-ray.origin().z()) / ray.direction().z();
+    if (t < tmin || t > tmax)
+        return false;
+    auto x = ray.origin().x() + t*ray.direction().x();
+    auto y = ray.origin().y() + t*ray.direction().y();
+    return !(x < x0_ || x > x1_ || y < y0_ || y > y1_);
 }
 
 bool XYRect::boundingBox(AABB& box) const {
@@ -35,6 +81,21 @@ bool XYRect::boundingBox(AABB& box) const {
     return true;
 }
 
+double XYRect::pdfValue(const Point3 & origin, const Vec3 & direction) const {
+    return rectanglePdf(*this, (x1_-x0_) * (y1_-y0_), origin, direction);
+}
+
+Vec3 XYRect::random(const Point3 & origin, Sampler & sampler) const {
+    Point2 u = sampler.get2D();
+    auto on_light = Point3(x0_ + u.x*(x1_-x0_), y0_ + u.y*(y1_-y0_), k_);
+    return on_light - origin;
+}
+
+void XYRect::collectLights(std::vector<const Hittable *> & lights) const {
+    if (m_->isEmissive())
+        lights.push_back(this);
+}
+
 //-----------------------------------------------------------------------------
 // Y - Z (wall)
 bool YZRect::hit(const Ray& ray, double tmin, double tmax, hit_record& record) const {
@@ -49,19 +110,47 @@ bool YZRect::hit(const Ray& ray, double tmin, double tmax, hit_record& record) c
     record.u = (y-y0_) / (y1_-y0_);
     record.v = (z-z0_) / (z1_-z0_);
     record.t = t;
-    auto outward_normal = Vec3(0, 0, 1);
-    record.setNormalDirection(ray, outward_normal);
-    record.material = m_;
-    record.point = ray.at(t);
+    record.object = this;
     return true;
 }
 
+void YZRect::surfaceDetails(const Ray& ray, hit_record& record) const {
+    auto outward_normal = Vec3(1, 0, 0);
+    record.setNormalDirection(ray, outward_normal);
+    record.material = m_.get();
+    record.point = ray.at(record.t);
+}
+
+bool YZRect::occluded(const Ray& ray, double tmin, double tmax) const {
+    auto t = (k_-ray.origin().x()) / ray.direction().x();
+    if (t < tmin || t > tmax)
+        return false;
+    auto y = ray.origin().y() + t*ray.direction().y();
+    auto z = ray.origin().z() + t*ray.direction().z();
+    return !(y < y0_ || y > y1_ || z < z0_ || z > z1_);
+}
+
 bool YZRect::boundingBox(AABB& box) const {
     // Add padding so the box has nonzero width
-    box = AABB(Point3(k_-0.0001, y0_, z0_), Point3(k_+0.0001, y0_, z0_));
+    box = AABB(Point3(k_-0.0001, y0_, z0_), Point3(k_+0.0001, y1_, z1_));
     return true;
 }
 
+double YZRect::pdfValue(const Point3 & origin, const Vec3 & direction) const {
+    return rectanglePdf(*this, (y1_-y0_) * (z1_-z0_), origin, direction);
+}
+
+Vec3 YZRect::random(const Point3 & origin, Sampler & sampler) const {
+    Point2 u = sampler.get2D();
+    auto on_light = Point3(k_, y0_ + u.x*(y1_-y0_), z0_ + u.y*(z1_-z0_));
+    return on_light - origin;
+}
+
+void YZRect::collectLights(std::vector<const Hittable *> & lights) const {
+    if (m_->isEmissive())
+        lights.push_back(this);
+}
+
 //-----------------------------------------------------------------------------
 // X - Z (ground/ceiling)
 bool XZRect::hit(const Ray& ray, double tmin, double tmax, hit_record& record) const {
@@ -76,11 +165,24 @@ bool XZRect::hit(const Ray& ray, double tmin, double tmax, hit_record& record) c
     record.u = (x-x0_) / (x1_-x0_);
     record.v = (z-z0_) / (z1_-z0_);
     record.t = t;
+    record.object = this;
+    return true;
+}
+
+void XZRect::surfaceDetails(const Ray& ray, hit_record& record) const {
     auto outward_normal = Vec3(0, 1, 0);
     record.setNormalDirection(ray, outward_normal);
-    record.material = m_;
-    record.point = ray.at(t);
-    return true;
+    record.material = m_.get();
+    record.point = ray.at(record.t);
+}
+
+bool XZRect::occluded(const Ray& ray, double tmin, double tmax) const {
+    auto t = (k_-ray.origin().y()) / ray.direction().y();
+    if (t < tmin || t > tmax)
+        return false;
+    auto x = ray.origin().x() + t*ray.direction().x();
+    auto z = ray.origin().z() + t*ray.direction().z();
+    return !(x < x0_ || x > x1_ || z < z0_ || z > z1_);
 }
 
 bool XZRect::boundingBox(AABB & box) const {
@@ -88,5 +190,20 @@ bool XZRect::boundingBox(AABB & box) const {
     box = AABB(Point3(x0_, k_-0.0001, z0_), Point3(x1_, k_+0.0001, z1_));
     return true;
 }
+
+double XZRect::pdfValue(const Point3 & origin, const Vec3 & direction) const {
+    return rectanglePdf(*this, (x1_-x0_) * (z1_-z0_), origin, direction);
+}
+
+Vec3 XZRect::random(const Point3 & origin, Sampler & sampler) const {
+    Point2 u = sampler.get2D();
+    auto on_light = Point3(x0_ + u.x*(x1_-x0_), k_, z0_ + u.y*(z1_-z0_));
+    return on_light - origin;
+}
+
+void XZRect::collectLights(std::vector<const Hittable *> & lights) const {
+    if (m_->isEmissive())
+        lights.push_back(this);
+}
     
 } // namespace rudnick_rt
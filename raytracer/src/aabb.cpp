@@ -15,19 +15,27 @@ Point3 AABB::centroid() const
     return min_ + ((max_ - min_) / 2);
 }
 
+double AABB::surfaceArea() const
+{
+    auto d = max_ - min_;
+    return 2 * (d.x()*d.y() + d.y()*d.z() + d.z()*d.x());
+}
+
 /**
  * Using the optimized hit method proposed by Andrew Kensler at Pixar.
+ * The ray's inverse direction and direction signs are computed when the ray
+ * is made, so there's no division or branch on the direction here.
  */
 bool AABB::hit(const Ray& ray, double tmin, double tmax) const
 {
+    const Vec3 & inv_dir = ray.invDirection();
+    const int * dir_is_neg = ray.dirIsNeg();
+    const Point3 * bounds[2] = {&min_, &max_};
     for (int i = 0; i < 3; i++) {
-        auto inv_dir = 1.0f / ray.direction()[i];
-        auto t0 = (min()[i] - ray.origin()[i]) * inv_dir;
-        auto t1 = (max()[i] - ray.origin()[i]) * inv_dir;
+        auto origin = ray.origin_[i];
+        auto t0 = ((*bounds[dir_is_neg[i]])[i] - origin) * inv_dir[i];
+        auto t1 = ((*bounds[1 - dir_is_neg[i]])[i] - origin) * inv_dir[i];
 
-        if (inv_dir < 0.0f) {
-            std::swap(t0, t1);
-        }
         tmin = t0 > tmin ? t0 : tmin;
         tmax = t1 < tmax ? t1 : tmax;
 
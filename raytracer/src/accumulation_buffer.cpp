@@ -0,0 +1,140 @@
+/**
+ * @file accumulation_buffer.cpp
+ * @author Ian Rudnick
+ * Implementation of the floating-point accumulation buffer.
+ */
+#include "accumulation_buffer.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+#include "rgba_pixel.h"
+
+namespace rudnick_rt {
+
+namespace {
+
+/**
+ * Start of every checkpoint file.
+ */
+struct CheckpointHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t pixel_size;
+    uint64_t key;
+};
+
+constexpr char kCheckpointMagic[8] = {'R', 'R', 'T', 'C', 'K', 'P', 'T', 0};
+// Version 2 keeps the luminance statistics in double precision.
+constexpr uint32_t kCheckpointVersion = 2;
+
+} // namespace
+
+void AccumulationBuffer::Pixel::add(const RGBColor & color) {
+    red += static_cast<float>(color.x());
+    green += static_cast<float>(color.y());
+    blue += static_cast<float>(color.z());
+    ++samples;
+    double luminance = luminanceOf(color);
+    double delta = luminance - luminance_mean;
+    luminance_mean += delta / samples;
+    luminance_m2 += delta * (luminance - luminance_mean);
+}
+
+RGBColor AccumulationBuffer::Pixel::mean() const {
+    if (samples == 0)
+        return RGBColor(0, 0, 0);
+    return RGBColor(red, green, blue) / samples;
+}
+
+double AccumulationBuffer::Pixel::luminanceError() const {
+    if (samples < 2)
+        return std::numeric_limits<double>::max();
+    double variance = luminance_m2 / (samples - 1);
+    return std::sqrt(variance / samples);
+}
+
+AccumulationBuffer::AccumulationBuffer(int width, int height)
+    : width_(width), height_(height), pixels_(size_t(width) * height) {}
+
+void AccumulationBuffer::toPNG(PNG & image) const {
+    // The PNG's (0, 0) is the upper-left corner, so flip the y-coordinate.
+    for (int y = 0; y < height_; ++y) {
+        for (int x = 0; x < width_; ++x) {
+            image.getPixel(x, height_ - 1 - y).setColor(at(x, y).mean());
+        }
+    }
+}
+
+bool AccumulationBuffer::save(const std::string & filename,
+                              uint64_t key) const {
+    CheckpointHeader header;
+    std::memcpy(header.magic, kCheckpointMagic, sizeof(header.magic));
+    header.version = kCheckpointVersion;
+    header.width = width_;
+    header.height = height_;
+    header.pixel_size = sizeof(Pixel);
+    header.key = key;
+
+    // Write to a temporary file and move it into place, so the last good
+    // checkpoint survives if this one gets cut off.
+    std::string temp_path = filename + ".tmp";
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(pixels_.data()),
+                  pixels_.size() * sizeof(Pixel));
+        if (!out) {
+            out.close();
+            std::remove(temp_path.c_str());
+            return false;
+        }
+    }
+#ifdef WIN32
+    // Windows won't rename over an existing file.
+    std::remove(filename.c_str());
+#endif
+    if (std::rename(temp_path.c_str(), filename.c_str()) != 0) {
+        std::remove(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool AccumulationBuffer::load(const std::string & filename, uint64_t key) {
+    std::ifstream in(filename, std::ios::binary);
+    if (!in) return false;
+
+    CheckpointHeader header;
+    in.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (!in ||
+        std::memcmp(header.magic, kCheckpointMagic, sizeof(header.magic)) ||
+        header.version != kCheckpointVersion ||
+        header.width != uint32_t(width_) ||
+        header.height != uint32_t(height_) ||
+        header.pixel_size != sizeof(Pixel) ||
+        header.key != key)
+        return false;
+
+    std::vector<Pixel> pixels(pixels_.size());
+    in.read(reinterpret_cast<char *>(pixels.data()),
+            pixels.size() * sizeof(Pixel));
+    if (!in) return false;
+    pixels_.swap(pixels);
+    return true;
+}
+
+uint64_t AccumulationBuffer::totalSamples() const {
+    uint64_t total = 0;
+    for (const Pixel & pixel : pixels_)
+        total += pixel.samples;
+    return total;
+}
+
+} // namespace rudnick_rt
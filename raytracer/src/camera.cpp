@@ -23,6 +23,7 @@ Camera::Camera() {
     vertical_ = Vec3(0.0, viewport_height, 0.0);
     lower_left_corner_ = origin_ - horizontal_/2.0 - vertical_/2.0
                        - Vec3(0, 0, focal_length);
+    lens_radius_ = 0;
 }
 
 Camera::Camera(Point3 viewpt, Point3 lookat, Vec3 up, double fov,
@@ -62,5 +63,19 @@ Ray Camera::getRay(double s, double t, RRTenum projection) const {
     }
     return Ray(ray_origin, ray_direction);
 }
+
+Ray Camera::getRay(double s, double t, RRTenum projection,
+                   Sampler & sampler) const {
+    Point2 lens_sample = sampler.get2D();
+    if (projection != RRTenum::PERSPECTIVE || lens_radius_ <= 0)
+        return getRay(s, t, projection);
+
+    // Start the ray from a point on the lens, but aim it at the same spot on
+    // the focus plane, so only things off that plane get blurred.
+    Vec3 on_disc = lens_radius_ * sampleUnitDisc(lens_sample);
+    Vec3 offset = u_ * on_disc.x() + v_ * on_disc.y();
+    Point3 screen_pixel = lower_left_corner_ + s*horizontal_ + t*vertical_;
+    return Ray(origin_ + offset, screen_pixel - origin_ - offset);
+}
     
 } // namespace rudnick_rt
@@ -13,22 +13,29 @@ namespace rudnick_rt {
 bool HittableList::hit(
     const Ray & ray, double tmin, double tmax, hit_record & record
 ) const {
-    hit_record temp_record;
     bool hit_anything = false;
     auto closest = tmax;
 
-    // Go through the objects vector
+    // Go through the objects vector. Objects only write to the record when
+    // they report a closer hit, so it doesn't need a temporary copy.
     for (const auto & object : objects_) {
-        if (object->hit(ray, tmin, closest, temp_record)) {
+        if (object->hit(ray, tmin, closest, record)) {
             hit_anything = true;
-            closest = temp_record.t;
-            record = temp_record;
+            closest = record.t;
         }
     }
 
     return hit_anything;
 }
 
+bool HittableList::occluded(const Ray & ray, double tmin, double tmax) const {
+    for (const auto & object : objects_) {
+        if (object->occluded(ray, tmin, tmax))
+            return true;
+    }
+    return false;
+}
+
 bool HittableList::boundingBox(AABB& output) const {
     if (this->objects_.empty()) {
         return false;
@@ -47,4 +54,10 @@ bool HittableList::boundingBox(AABB& output) const {
     return true;
 }
 
+void HittableList::collectLights(std::vector<const Hittable *> & lights) const {
+    for (const auto & object : objects_) {
+        object->collectLights(lights);
+    }
+}
+
 } // namespace rudnick_rt
@@ -1,99 +1,61 @@
 #include "instance.h"
 
+#include <cassert>
 #include <cmath>
 
 #include "ray.h"
+#include "triangle_mesh.h"
 #include "utils.h"
 
 namespace rudnick_rt {
 
 //-----------------------------------------------------------------------------
-// Translate
-bool Translate::hit(
-    const Ray & ray, double tmin, double tmax, hit_record & record
-) const {
-    Ray moved(ray.origin() - displacement_, ray.direction());
-    if (!ptr_->hit(moved, tmin, tmax, record))
-        return false;
-    
-    record.point += displacement_;
-    record.setNormalDirection(moved, record.normal);
-    return true;
-}
-
-
-bool Translate::boundingBox(AABB & box) const {
-    if (!ptr_->boundingBox(box))
-        return false;
-
-    box = AABB(box.min() + displacement_, box.max() + displacement_);
-    return true;
-}
-
+// Transform
+Transform::Transform(shared_ptr<Hittable> p, const Matrix34 & matrix)
+    : ptr_(p), matrix_(matrix) {
+    // Fold a transformed child into this one, so hits only pass through one
+    // matrix however deep the stack goes.
+    auto child = std::dynamic_pointer_cast<Transform>(p);
+    if (child) {
+        ptr_ = child->ptr_;
+        matrix_ = matrix * child->matrix_;
+    }
+    inverse_ = matrix_.inverse();
 
-//-----------------------------------------------------------------------------
-// Rotate Y
-RotateY::RotateY(shared_ptr<Hittable> p, double angle) : ptr_(p) {
-    auto radians = degToRad(angle);
-    sin_ = std::sin(radians);
-    cos_ = std::cos(radians);
     has_box_ = ptr_->boundingBox(box_);
-
-    Point3 min(infinity, infinity, infinity);
-    Point3 max(-infinity, -infinity, -infinity);
-
-    for (int i = 0; i < 2; ++i) {
-        for (int j = 0; j < 2; ++j) {
-            for (int k = 0; k < 2; ++k) {
-                auto x = i*box_.max().x() + (1-i)*box_.min().x();
-                auto y = j*box_.max().y() + (1-j)*box_.min().y();
-                auto z = k*box_.max().z() + (1-k)*box_.min().z();
-
-                auto newx = cos_ * x + sin_ * z;
-                auto newz = -sin_ * x + cos_ * z;
-
-                // Figure out the bounding box
-                Vec3 test(newx, y, newz);
-                for (int c = 0; c < 3; c++) {
-                    min[c] = fmin(min[c], test[c]);
-                    max[c] = fmax(max[c], test[c]);
-                }
-            }
-        }
+    if (has_box_) {
+        box_ = matrix_.transformBox(box_);
     }
-
-    box_ = AABB(min, max);
 }
 
 
-bool RotateY::hit(
+bool Transform::hit(
     const Ray & ray, double tmin, double tmax, hit_record & record
 ) const {
-    auto origin = ray.origin();
-    auto direction = ray.direction();
-    origin[0] = cos_*ray.origin()[0] - sin_*ray.origin()[2];
-    origin[2] = sin_*ray.origin()[0] + cos_*ray.origin()[2];
-    direction[0] = cos_*ray.direction()[0] - sin_*ray.direction()[2];
-    direction[2] = sin_*ray.direction()[0] + cos_*ray.direction()[2];
-
-    Ray rotated(origin, direction);
-    if (!ptr_->hit(rotated, tmin, tmax, record))
+    // The direction isn't normalized, so t is the same in both spaces.
+    Ray local(inverse_.transformPoint(ray.origin()),
+              inverse_.transformVector(ray.direction()));
+    if (!ptr_->hit(local, tmin, tmax, record))
         return false;
+    record.object->surfaceDetails(local, record);
+    record.object = this;
 
-    auto point = record.point;
-    auto normal = record.normal;
-    point[0] = cos_*record.point[0] + sin_*record.point[2];
-    point[2] = -sin_*record.point[0] + cos_*record.point[2];
-    normal[0] = cos_*record.normal[0] + sin_*record.normal[2];
-    normal[2] = -sin_*record.normal[0] + cos_*record.normal[2];
-
-    record.point = point;
-    record.setNormalDirection(rotated, normal);
+    // The normal already faces against the ray, and the inverse transpose
+    // keeps it that way, so which side was hit doesn't change.
+    record.point = ray.at(record.t);
+    record.normal = Vec3::normalize(inverse_.transformNormal(record.normal));
     return true;
 }
 
 
-bool RotateY::boundingBox(AABB & box) const {
+bool Transform::occluded(const Ray & ray, double tmin, double tmax) const {
+    Ray local(inverse_.transformPoint(ray.origin()),
+              inverse_.transformVector(ray.direction()));
+    return ptr_->occluded(local, tmin, tmax);
+}
+
+
+bool Transform::boundingBox(AABB & box) const {
     box = box_;
     return has_box_;
 }
@@ -104,15 +66,67 @@ bool RotateY::boundingBox(AABB & box) const {
 bool Recolor::hit(
     const Ray& ray, double tmin, double tmax, hit_record& record
 ) const {
-    bool hit_result = ptr_->hit(ray, tmin, tmax, record);
+    if (!ptr_->hit(ray, tmin, tmax, record))
+        return false;
+    record.object->surfaceDetails(ray, record);
+    record.object = this;
     // Overwrite the hit material with the recolor's material
-    record.material = this->mat_;
-    return hit_result;
+    record.material = this->mat_.get();
+    return true;
+}
+
+
+bool Recolor::occluded(const Ray & ray, double tmin, double tmax) const {
+    return ptr_->occluded(ray, tmin, tmax);
 }
 
 
 bool Recolor::boundingBox(AABB& box) const {
     return ptr_->boundingBox(box);
 }
+
+
+//-----------------------------------------------------------------------------
+// Mesh Instance
+MeshInstance::MeshInstance(std::shared_ptr<const TriangleMesh> mesh,
+                           const Matrix34 & matrix,
+                           std::shared_ptr<Material> mat)
+    : mesh_(mesh), matrix_(matrix), inverse_(matrix.inverse()), mat_(mat) {
+    assert(mat_);
+}
+
+
+bool MeshInstance::hit(
+    const Ray & ray, double tmin, double tmax, hit_record & record
+) const {
+    if (!mesh_->hit(toLocal(ray), tmin, tmax, record))
+        return false;
+    // The mesh noted which triangle was hit. Take the record over, so the
+    // details come back here once this is known to be the closest hit.
+    record.object = this;
+    return true;
+}
+
+
+void MeshInstance::surfaceDetails(const Ray & ray, hit_record & record) const {
+    mesh_->surfaceDetails(toLocal(ray), record);
+    record.point = ray.at(record.t);
+    record.normal = Vec3::normalize(inverse_.transformNormal(record.normal));
+    record.material = mat_.get();
+}
+
+
+bool MeshInstance::occluded(const Ray & ray, double tmin, double tmax) const {
+    return mesh_->occluded(toLocal(ray), tmin, tmax);
+}
+
+
+bool MeshInstance::boundingBox(AABB & box) const {
+    if (!mesh_->boundingBox(box))
+        return false;
+
+    box = matrix_.transformBox(box);
+    return true;
+}
     
 } // namespace rudnick_rt
@@ -0,0 +1,888 @@
+/**
+ * @file linear_bvh.cpp
+ * @author Ian Rudnick
+ * Builder for the flattened Bounding Volume Hierarchy.
+ */
+#include "linear_bvh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "task_pool.h"
+#include "utils.h"
+
+
+namespace rudnick_rt {
+//-----------------------------------------------------------------------------
+// Build helpers
+
+namespace {
+
+// Number of buckets to bin the centroids into along each axis.
+const int kSAHBuckets = 16;
+
+// Cost of traversing a node, relative to the cost of hitting one primitive.
+const double kTraversalCost = 0.5;
+
+// Past this depth, nodes are split at the median so the tree can't get
+// deeper than kMaxDepth.
+const int kMaxSAHDepth = LinearBVH::kMaxDepth / 2;
+
+// Fewest primitives worth giving their own chunk of a parallel loop.
+const size_t kMinChunkSize = 16384;
+
+// Nodes with at least this many primitives are binned and partitioned in
+// parallel chunks.
+const size_t kParallelSplitSize = 4 * kMinChunkSize;
+
+// Children with at least this many primitives are built as separate tasks.
+const size_t kParallelSubtreeSize = 4096;
+
+/**
+ * What the builder needs to know about each primitive. The builder sorts an
+ * array of these in place, so the primitives themselves are never touched.
+ */
+struct PrimitiveInfo {
+    AABB box;
+    Point3 centroid;
+    uint32_t index;
+};
+
+// A bucket of primitives whose centroids fall in the same slice of an axis.
+struct SAHBucket {
+    SAHBucket() : count(0) {}
+    size_t count;
+    AABB box;
+};
+
+/**
+ * Maps centroids to SAH buckets along one axis.
+ */
+struct BucketMapper {
+    BucketMapper(const AABB & centroid_bounds, int axis)
+        : axis(axis),
+          min(centroid_bounds.min()[axis]),
+          scale(kSAHBuckets / (centroid_bounds.max()[axis] - min)) {}
+
+    int operator()(const Point3 & centroid) const {
+        int b = static_cast<int>((centroid[axis] - min) * scale);
+        return b < kSAHBuckets ? b : kSAHBuckets - 1;
+    }
+
+    int axis;
+    double min;
+    double scale;
+};
+
+// The buckets along each of the three axes.
+struct SAHBins {
+    SAHBucket buckets[3][kSAHBuckets];
+};
+
+/**
+ * Bins a range of primitives along each axis. Axes where the centroids
+ * don't spread out are left empty.
+ * @param prims The array of primitive info being built.
+ * @param start Index of the first primitive to bin.
+ * @param end Index one past the last primitive to bin.
+ * @param centroid_bounds Bounding box surrounding the whole node's centroids.
+ * @param bins Output for the buckets.
+ */
+void binPrimitives(const std::vector<PrimitiveInfo> & prims,
+                   size_t start, size_t end,
+                   const AABB & centroid_bounds, SAHBins & bins) {
+    auto extent = centroid_bounds.max() - centroid_bounds.min();
+    for (int axis = 0; axis < 3; ++axis) {
+        if (extent[axis] <= 0) continue;
+
+        BucketMapper bucket_of(centroid_bounds, axis);
+        SAHBucket * buckets = bins.buckets[axis];
+        for (size_t i = start; i < end; ++i) {
+            auto & bucket = buckets[bucket_of(prims[i].centroid)];
+            bucket.box = bucket.count == 0
+                ? prims[i].box : AABB::surroundingBox(bucket.box, prims[i].box);
+            ++bucket.count;
+        }
+    }
+}
+
+/**
+ * Adds the buckets from one set of bins into another.
+ */
+void mergeBins(SAHBins & bins, const SAHBins & other) {
+    for (int axis = 0; axis < 3; ++axis) {
+        for (int b = 0; b < kSAHBuckets; ++b) {
+            SAHBucket & bucket = bins.buckets[axis][b];
+            const SAHBucket & from = other.buckets[axis][b];
+            if (from.count == 0) continue;
+            bucket.box = bucket.count == 0
+                ? from.box : AABB::surroundingBox(bucket.box, from.box);
+            bucket.count += from.count;
+        }
+    }
+}
+
+/**
+ * Finds the cheapest split from a node's binned primitives.
+ * @param bins The node's primitives, binned by binPrimitives().
+ * @param bounds Bounding box surrounding all of the primitives.
+ * @param centroid_bounds Bounding box surrounding the primitives' centroids.
+ * @param best_axis Output for the axis of the cheapest split.
+ * @param best_bucket Output for the last bucket on the left of the split.
+ * @return The SAH cost of the cheapest split, or infinity if the centroids
+ *         are all in the same place and can't be split.
+ */
+double findSAHSplit(const SAHBins & bins,
+                    const AABB & bounds, const AABB & centroid_bounds,
+                    int & best_axis, int & best_bucket) {
+    double best_cost = infinity;
+    auto extent = centroid_bounds.max() - centroid_bounds.min();
+
+    for (int axis = 0; axis < 3; ++axis) {
+        if (extent[axis] <= 0) continue;
+        const SAHBucket * buckets = bins.buckets[axis];
+
+        // Sweep from the right to get the area and count of every right side.
+        double right_area[kSAHBuckets];
+        size_t right_count[kSAHBuckets];
+        SAHBucket right;
+        for (int b = kSAHBuckets - 1; b > 0; --b) {
+            if (buckets[b].count > 0) {
+                right.box = right.count == 0
+                    ? buckets[b].box
+                    : AABB::surroundingBox(right.box, buckets[b].box);
+                right.count += buckets[b].count;
+            }
+            right_area[b] = right.count > 0 ? right.box.surfaceArea() : 0;
+            right_count[b] = right.count;
+        }
+
+        // Sweep from the left, costing the split after each bucket.
+        SAHBucket left;
+        for (int b = 0; b < kSAHBuckets - 1; ++b) {
+            if (buckets[b].count > 0) {
+                left.box = left.count == 0
+                    ? buckets[b].box
+                    : AABB::surroundingBox(left.box, buckets[b].box);
+                left.count += buckets[b].count;
+            }
+            if (left.count == 0 || right_count[b + 1] == 0) continue;
+
+            double cost = kTraversalCost
+                + (left.count * left.box.surfaceArea()
+                   + right_count[b + 1] * right_area[b + 1])
+                / bounds.surfaceArea();
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_bucket = b;
+            }
+        }
+    }
+    return best_cost;
+}
+
+//-----------------------------------------------------------------------------
+// Parallel build helpers
+
+/**
+ * Splits [0, count) into chunks for a parallel loop, one per thread unless
+ * that would make them too small.
+ * @param count The number of items.
+ * @param size Output for the chunk size. Chunk c covers
+ *             [c * size, min((c+1) * size, count)).
+ * @param threads The number of threads the loop will run on.
+ * @return The number of chunks.
+ */
+size_t numChunks(size_t count, size_t & size, unsigned threads) {
+    size_t chunks = std::min<size_t>(threads,
+                                     (count + kMinChunkSize - 1)
+                                     / kMinChunkSize);
+    chunks = std::max<size_t>(chunks, 1);
+    size = (count + chunks - 1) / chunks;
+    return chunks;
+}
+
+/**
+ * Runs body(c) for every chunk c in [0, chunks), as tasks on a pool. The
+ * calling thread runs the first chunk itself.
+ * @param chunks The number of chunks.
+ * @param pool The pool to run on, or null to run every chunk in order.
+ * @param body The function to call for each chunk.
+ */
+template <typename Function>
+void runChunks(size_t chunks, TaskPool * pool, const Function & body) {
+    if (pool == nullptr || chunks == 1) {
+        for (size_t c = 0; c < chunks; ++c) body(c);
+        return;
+    }
+    TaskGroup group(*pool);
+    for (size_t c = 1; c < chunks; ++c) {
+        group.run([&body, c] { body(c); });
+    }
+    body(0);
+    group.wait();
+}
+
+/**
+ * Finds the bounds of a range of primitives and of their centroids.
+ * Large ranges are split into chunks that run in parallel.
+ * @param prims The array of primitive info being built.
+ * @param start Index of the first primitive.
+ * @param end Index one past the last primitive.
+ * @param pool The pool to run on, or null to run serially.
+ * @param bounds Output for the bounds of the primitives.
+ * @param centroid_bounds Output for the bounds of the centroids.
+ */
+void findBounds(const std::vector<PrimitiveInfo> & prims,
+                size_t start, size_t end, TaskPool * pool,
+                AABB & bounds, AABB & centroid_bounds) {
+    size_t chunk_size;
+    size_t chunks = end - start >= kParallelSplitSize && pool
+        ? numChunks(end - start, chunk_size, pool->size())
+        : numChunks(end - start, chunk_size, 1);
+
+    std::vector<AABB> chunk_bounds(chunks);
+    std::vector<AABB> chunk_centroids(chunks);
+    runChunks(chunks, pool, [&](size_t c) {
+        size_t first = start + c * chunk_size;
+        size_t last = std::min(end, first + chunk_size);
+        AABB box = prims[first].box;
+        Point3 min = prims[first].centroid;
+        Point3 max = prims[first].centroid;
+        for (size_t i = first + 1; i < last; ++i) {
+            box = AABB::surroundingBox(box, prims[i].box);
+            for (int axis = 0; axis < 3; ++axis) {
+                min[axis] = std::min(min[axis], prims[i].centroid[axis]);
+                max[axis] = std::max(max[axis], prims[i].centroid[axis]);
+            }
+        }
+        chunk_bounds[c] = box;
+        chunk_centroids[c] = AABB(min, max);
+    });
+
+    bounds = chunk_bounds[0];
+    centroid_bounds = chunk_centroids[0];
+    for (size_t c = 1; c < chunks; ++c) {
+        bounds = AABB::surroundingBox(bounds, chunk_bounds[c]);
+        centroid_bounds = AABB::surroundingBox(centroid_bounds,
+                                               chunk_centroids[c]);
+    }
+}
+
+/**
+ * Bins a node's primitives for the SAH. Large nodes are binned in parallel
+ * chunks, and the chunks' bins are merged.
+ * @param prims The array of primitive info being built.
+ * @param start Index of the first primitive in the node.
+ * @param end Index one past the last primitive in the node.
+ * @param centroid_bounds Bounding box surrounding the primitives' centroids.
+ * @param pool The pool to run on, or null to run serially.
+ * @param bins Output for the buckets.
+ */
+void binNode(const std::vector<PrimitiveInfo> & prims,
+             size_t start, size_t end, const AABB & centroid_bounds,
+             TaskPool * pool, SAHBins & bins) {
+    if (end - start < kParallelSplitSize || pool == nullptr) {
+        binPrimitives(prims, start, end, centroid_bounds, bins);
+        return;
+    }
+    size_t chunk_size;
+    size_t chunks = numChunks(end - start, chunk_size, pool->size());
+    std::vector<SAHBins> chunk_bins(chunks);
+    runChunks(chunks, pool, [&](size_t c) {
+        size_t first = start + c * chunk_size;
+        binPrimitives(prims, first, std::min(end, first + chunk_size),
+                      centroid_bounds, chunk_bins[c]);
+    });
+    for (size_t c = 0; c < chunks; ++c) {
+        mergeBins(bins, chunk_bins[c]);
+    }
+}
+
+/**
+ * Partitions a range of primitives so that the ones matching a predicate
+ * come first. Large ranges use a stable partition split into parallel
+ * chunks. Since it's stable, the result doesn't depend on how many threads
+ * there are.
+ * @param prims The array of primitive info being built.
+ * @param start Index of the first primitive.
+ * @param end Index one past the last primitive.
+ * @param pool The pool to run on, or null to run serially.
+ * @param goes_left Predicate that's true for primitives that go first.
+ * @return Index of the first primitive that doesn't match.
+ */
+template <typename Predicate>
+size_t partitionPrimitives(std::vector<PrimitiveInfo> & prims,
+                           size_t start, size_t end, TaskPool * pool,
+                           const Predicate & goes_left) {
+    if (end - start < kParallelSplitSize) {
+        return std::partition(prims.begin() + start, prims.begin() + end,
+                              goes_left) - prims.begin();
+    }
+    size_t chunk_size;
+    size_t chunks = numChunks(end - start, chunk_size,
+                              pool ? pool->size() : 1);
+
+    // Count the primitives going left in each chunk.
+    std::vector<size_t> left_offsets(chunks);
+    std::vector<size_t> right_offsets(chunks);
+    runChunks(chunks, pool, [&](size_t c) {
+        size_t first = start + c * chunk_size;
+        size_t last = std::min(end, first + chunk_size);
+        size_t count = 0;
+        for (size_t i = first; i < last; ++i) {
+            if (goes_left(prims[i])) ++count;
+        }
+        left_offsets[c] = count;
+    });
+
+    // Turn the counts into where each chunk writes its two sides.
+    size_t num_left = 0;
+    for (size_t c = 0; c < chunks; ++c) {
+        size_t count = left_offsets[c];
+        left_offsets[c] = num_left;
+        num_left += count;
+    }
+    size_t num_right = 0;
+    for (size_t c = 0; c < chunks; ++c) {
+        size_t first = start + c * chunk_size;
+        size_t last = std::min(end, first + chunk_size);
+        size_t count = (last - first) - (c + 1 < chunks
+            ? left_offsets[c + 1] - left_offsets[c]
+            : num_left - left_offsets[c]);
+        right_offsets[c] = num_left + num_right;
+        num_right += count;
+    }
+
+    std::vector<PrimitiveInfo> scratch(end - start);
+    runChunks(chunks, pool, [&](size_t c) {
+        size_t first = start + c * chunk_size;
+        size_t last = std::min(end, first + chunk_size);
+        size_t left = left_offsets[c];
+        size_t right = right_offsets[c];
+        for (size_t i = first; i < last; ++i) {
+            scratch[goes_left(prims[i]) ? left++ : right++] = prims[i];
+        }
+    });
+    runChunks(chunks, pool, [&](size_t c) {
+        size_t first = c * chunk_size;
+        size_t last = std::min(scratch.size(), first + chunk_size);
+        std::copy(scratch.begin() + first, scratch.begin() + last,
+                  prims.begin() + start + first);
+    });
+    return start + num_left;
+}
+
+/**
+ * Appends a subtree that was built in its own node array, moving its second
+ * child offsets to where it ends up.
+ * @param nodes The node array to append to.
+ * @param subtree The subtree's nodes, with offsets relative to its root.
+ */
+void appendSubtree(std::vector<LinearBVHNode> & nodes,
+                   const std::vector<LinearBVHNode> & subtree) {
+    uint32_t base = static_cast<uint32_t>(nodes.size());
+    for (LinearBVHNode node : subtree) {
+        if (node.num_primitives == 0) {
+            node.second_child_offset += base;
+        }
+        nodes.push_back(node);
+    }
+}
+
+/**
+ * Rounds a double down to the nearest float at or below it.
+ */
+float roundDown(double x) {
+    float f = static_cast<float>(x);
+    return f > x ? std::nextafter(f, -std::numeric_limits<float>::max()) : f;
+}
+
+/**
+ * Rounds a double up to the nearest float at or above it.
+ */
+float roundUp(double x) {
+    float f = static_cast<float>(x);
+    return f < x ? std::nextafter(f, std::numeric_limits<float>::max()) : f;
+}
+
+/**
+ * Stores a box in a node, rounding outwards so the node's box never misses
+ * something the exact box would hit.
+ */
+void setNodeBounds(LinearBVHNode & node, const AABB & box) {
+    for (int i = 0; i < 3; ++i) {
+        node.min[i] = roundDown(box.min()[i]);
+        node.max[i] = roundUp(box.max()[i]);
+    }
+}
+
+/**
+ * Gets the axis where a box is widest.
+ */
+int maxExtentAxis(const AABB & box) {
+    auto extent = box.max() - box.min();
+    if (extent.x() > extent.y() && extent.x() > extent.z())
+        return 0;
+    else if (extent.y() > extent.z())
+        return 1;
+    else
+        return 2;
+}
+
+/**
+ * Recursively builds the subtree over a range of the primitive info array,
+ * appending its nodes depth-first. Partitions the range in place.
+ * @param prims The array of primitive info being built.
+ * @param start Index of the first primitive to put under this node.
+ * @param end Index one past the last primitive to put under this node.
+ * @param depth Depth of this node in the tree.
+ * @param method How to choose where to split the primitives.
+ * @param max_leaf_size The most primitives a leaf node can hold.
+ * @param nodes The node array to append to.
+ * @param pool The pool to build big subtrees on, or null to build serially.
+ *             Either way the nodes come out the same.
+ */
+void buildNode(std::vector<PrimitiveInfo> & prims, size_t start, size_t end,
+               int depth, BVHSplitMethod method, size_t max_leaf_size,
+               std::vector<LinearBVHNode> & nodes, TaskPool * pool) {
+    size_t num_primitives = end - start;
+
+    // Find the bounds of the primitives and the bounds of their centroids.
+    AABB bounds, centroid_bounds;
+    findBounds(prims, start, end, pool, bounds, centroid_bounds);
+
+    // Pick where to split the primitives. Splitting at start makes a leaf.
+    size_t partition_point = start;
+    int axis = maxExtentAxis(centroid_bounds);
+
+    if (num_primitives > max_leaf_size && depth >= kMaxSAHDepth) {
+        // Too deep to trust the split method, so split evenly at the median.
+        partition_point = start + num_primitives / 2;
+        std::nth_element(prims.begin()+start, prims.begin()+partition_point,
+                         prims.begin()+end,
+                         [axis](const PrimitiveInfo & a,
+                                const PrimitiveInfo & b) {
+                             return a.centroid[axis] < b.centroid[axis];
+                         });
+    }
+    else if (method == BVHSplitMethod::SAH && num_primitives > 1) {
+        int bucket = 0;
+        SAHBins bins;
+        binNode(prims, start, end, centroid_bounds, pool, bins);
+        double split_cost = findSAHSplit(bins, bounds, centroid_bounds,
+                                         axis, bucket);
+        double leaf_cost = static_cast<double>(num_primitives);
+
+        // Only split a small node if it's cheaper than hitting everything.
+        if (split_cost < infinity &&
+            (split_cost < leaf_cost || num_primitives > max_leaf_size)) {
+            BucketMapper bucket_of(centroid_bounds, axis);
+            partition_point = partitionPrimitives(
+                prims, start, end, pool,
+                [&bucket_of, bucket](const PrimitiveInfo & prim) {
+                    return bucket_of(prim.centroid) <= bucket;
+                });
+        }
+        // If the centroids all overlap, there's no good split, so just cut
+        // the primitives in half.
+        else if (num_primitives > max_leaf_size) {
+            partition_point = start + num_primitives / 2;
+        }
+    }
+    else if (method == BVHSplitMethod::MIDPOINT &&
+             num_primitives > max_leaf_size) {
+        // Partition the primitives whose centroid is below the midpoint.
+        auto midpoint = centroid_bounds.centroid()[axis];
+        partition_point = partitionPrimitives(
+            prims, start, end, pool,
+            [axis, midpoint](const PrimitiveInfo & prim) {
+                return prim.centroid[axis] < midpoint;
+            });
+        
+        if (partition_point == start || partition_point == end) {
+            partition_point = start + (end - start) / 2;
+        }
+    }
+
+    size_t node_index = nodes.size();
+    nodes.push_back(LinearBVHNode());
+    setNodeBounds(nodes[node_index], bounds);
+    nodes[node_index].pad = 0;
+
+    // Make a leaf holding all of the primitives.
+    if (partition_point == start) {
+        nodes[node_index].primitives_offset = static_cast<uint32_t>(start);
+        nodes[node_index].num_primitives =
+            static_cast<uint16_t>(num_primitives);
+        nodes[node_index].axis = 0;
+        return;
+    }
+
+    nodes[node_index].num_primitives = 0;
+    nodes[node_index].axis = static_cast<uint8_t>(axis);
+
+    // The first child goes right after this node, and the second child goes
+    // after the whole first subtree. When both are big, build the second one
+    // in its own array on another thread, and append it afterwards.
+    if (pool != nullptr &&
+        std::min(partition_point - start, end - partition_point)
+            >= kParallelSubtreeSize) {
+        std::vector<LinearBVHNode> second;
+        TaskGroup group(*pool);
+        group.run([&] {
+            buildNode(prims, partition_point, end, depth + 1, method,
+                      max_leaf_size, second, pool);
+        });
+        buildNode(prims, start, partition_point, depth + 1, method,
+                  max_leaf_size, nodes, pool);
+        group.wait();
+        nodes[node_index].second_child_offset =
+            static_cast<uint32_t>(nodes.size());
+        appendSubtree(nodes, second);
+        return;
+    }
+
+    buildNode(prims, start, partition_point, depth + 1, method,
+              max_leaf_size, nodes, pool);
+    nodes[node_index].second_child_offset =
+        static_cast<uint32_t>(nodes.size());
+    buildNode(prims, partition_point, end, depth + 1, method,
+              max_leaf_size, nodes, pool);
+}
+
+//-----------------------------------------------------------------------------
+// Morton build helpers
+
+// Bits of each centroid coordinate that go into a Morton code.
+const int kMortonBitsPerAxis = 10;
+
+// Radix sort digit size, in bits. Three passes cover a 30-bit code.
+const int kRadixBits = 10;
+const int kRadixBuckets = 1 << kRadixBits;
+
+// A primitive's position along the Morton curve.
+struct MortonPrimitive {
+    uint32_t code;
+    uint32_t index;
+};
+
+/**
+ * Spreads the low 10 bits of a number out so there are two zero bits
+ * between each of them.
+ */
+uint32_t spreadBits(uint32_t x) {
+    x = (x | (x << 16)) & 0x030000ff;
+    x = (x | (x << 8)) & 0x0300f00f;
+    x = (x | (x << 4)) & 0x030c30c3;
+    x = (x | (x << 2)) & 0x09249249;
+    return x;
+}
+
+/**
+ * Gets the 30-bit Morton code of a point, with x in the highest bit of each
+ * group of three.
+ * @param offset The point's position in the centroid bounds, each
+ *               coordinate in [0, 1].
+ */
+uint32_t mortonCode(const Vec3 & offset) {
+    const double scale = 1 << kMortonBitsPerAxis;
+    uint32_t code = 0;
+    for (int axis = 0; axis < 3; ++axis) {
+        double scaled = std::min(std::max(offset[axis] * scale, 0.0),
+                                 scale - 1);
+        code |= spreadBits(static_cast<uint32_t>(scaled)) << (2 - axis);
+    }
+    return code;
+}
+
+/**
+ * Sorts Morton primitives by code with a parallel least-significant-digit
+ * radix sort. The sort is stable.
+ * @param prims The primitives to sort.
+ * @param pool The pool to sort on, or null to sort serially.
+ */
+void radixSort(std::vector<MortonPrimitive> & prims, TaskPool * pool) {
+    std::vector<MortonPrimitive> scratch(prims.size());
+    size_t chunk_size;
+    size_t chunks = numChunks(prims.size(), chunk_size,
+                              pool ? pool->size() : 1);
+    std::vector<size_t> offsets(chunks * kRadixBuckets);
+
+    for (int shift = 0; shift < 3 * kMortonBitsPerAxis; shift += kRadixBits) {
+        // Count how many codes in each chunk have each digit.
+        runChunks(chunks, pool, [&](size_t c) {
+            size_t * counts = &offsets[c * kRadixBuckets];
+            std::fill(counts, counts + kRadixBuckets, 0);
+            size_t end = std::min(prims.size(), (c + 1) * chunk_size);
+            for (size_t i = c * chunk_size; i < end; ++i) {
+                ++counts[(prims[i].code >> shift) & (kRadixBuckets - 1)];
+            }
+        });
+
+        // Turn the counts into where each chunk writes each digit: digits in
+        // order, and chunks in order within a digit, which keeps it stable.
+        size_t total = 0;
+        for (int d = 0; d < kRadixBuckets; ++d) {
+            for (size_t c = 0; c < chunks; ++c) {
+                size_t count = offsets[c * kRadixBuckets + d];
+                offsets[c * kRadixBuckets + d] = total;
+                total += count;
+            }
+        }
+
+        runChunks(chunks, pool, [&](size_t c) {
+            size_t * next = &offsets[c * kRadixBuckets];
+            size_t end = std::min(prims.size(), (c + 1) * chunk_size);
+            for (size_t i = c * chunk_size; i < end; ++i) {
+                int digit = (prims[i].code >> shift) & (kRadixBuckets - 1);
+                scratch[next[digit]++] = prims[i];
+            }
+        });
+        prims.swap(scratch);
+    }
+}
+
+/**
+ * Gets the index of the highest set bit of a nonzero number.
+ */
+int highestBit(uint32_t x) {
+    int bit = 0;
+    while (x >>= 1) ++bit;
+    return bit;
+}
+
+/**
+ * Recursively builds the subtree over a range of Morton-sorted primitives,
+ * appending its nodes depth-first. Each node splits where the highest bit
+ * that differs within its range flips from 0 to 1.
+ * @param prims The primitive info, sorted by Morton code.
+ * @param codes Each primitive's Morton code, in the same order.
+ * @param start Index of the first primitive to put under this node.
+ * @param end Index one past the last primitive to put under this node.
+ * @param depth Depth of this node in the tree.
+ * @param max_leaf_size The most primitives a leaf node can hold.
+ * @param nodes The node array to append to.
+ * @param pool The pool to build big subtrees on, or null to build serially.
+ * @return The bounding box of the subtree.
+ */
+AABB buildMortonNode(const std::vector<PrimitiveInfo> & prims,
+                     const std::vector<MortonPrimitive> & codes,
+                     size_t start, size_t end, int depth,
+                     size_t max_leaf_size,
+                     std::vector<LinearBVHNode> & nodes, TaskPool * pool) {
+    size_t node_index = nodes.size();
+    nodes.push_back(LinearBVHNode());
+    nodes[node_index].pad = 0;
+
+    if (end - start <= max_leaf_size) {
+        AABB bounds = prims[start].box;
+        for (size_t i = start + 1; i < end; ++i) {
+            bounds = AABB::surroundingBox(bounds, prims[i].box);
+        }
+        setNodeBounds(nodes[node_index], bounds);
+        nodes[node_index].primitives_offset = static_cast<uint32_t>(start);
+        nodes[node_index].num_primitives =
+            static_cast<uint16_t>(end - start);
+        nodes[node_index].axis = 0;
+        return bounds;
+    }
+
+    // Identical codes, or a tree getting too deep, are split in half.
+    size_t split = start + (end - start) / 2;
+    int axis = 0;
+    uint32_t differing = codes[start].code ^ codes[end - 1].code;
+    if (differing != 0 && depth < kMaxSAHDepth) {
+        int bit = highestBit(differing);
+        uint32_t mask = 1u << bit;
+        split = std::partition_point(
+            codes.begin() + start, codes.begin() + end,
+            [mask](const MortonPrimitive & prim) {
+                return !(prim.code & mask);
+            }) - codes.begin();
+        axis = 2 - bit % 3;
+    }
+
+    nodes[node_index].num_primitives = 0;
+    nodes[node_index].axis = static_cast<uint8_t>(axis);
+
+    AABB bounds;
+    if (pool != nullptr &&
+        std::min(split - start, end - split) >= kParallelSubtreeSize) {
+        std::vector<LinearBVHNode> second;
+        AABB second_bounds;
+        TaskGroup group(*pool);
+        group.run([&] {
+            second_bounds = buildMortonNode(prims, codes, split, end,
+                                            depth + 1, max_leaf_size,
+                                            second, pool);
+        });
+        bounds = buildMortonNode(prims, codes, start, split, depth + 1,
+                                 max_leaf_size, nodes, pool);
+        group.wait();
+        nodes[node_index].second_child_offset =
+            static_cast<uint32_t>(nodes.size());
+        appendSubtree(nodes, second);
+        bounds = AABB::surroundingBox(bounds, second_bounds);
+    }
+    else {
+        bounds = buildMortonNode(prims, codes, start, split, depth + 1,
+                                 max_leaf_size, nodes, pool);
+        nodes[node_index].second_child_offset =
+            static_cast<uint32_t>(nodes.size());
+        bounds = AABB::surroundingBox(
+            bounds, buildMortonNode(prims, codes, split, end, depth + 1,
+                                    max_leaf_size, nodes, pool));
+    }
+    setNodeBounds(nodes[node_index], bounds);
+    return bounds;
+}
+
+/**
+ * Builds the whole tree with the Morton method. Sorts the primitive info
+ * into Morton order first.
+ * @param prims The array of primitive info being built.
+ * @param max_leaf_size The most primitives a leaf node can hold.
+ * @param nodes The node array to append to.
+ * @param pool The pool to build on, or null to build serially.
+ */
+void buildMorton(std::vector<PrimitiveInfo> & prims, size_t max_leaf_size,
+                 std::vector<LinearBVHNode> & nodes, TaskPool * pool) {
+    size_t chunk_size;
+    size_t chunks = numChunks(prims.size(), chunk_size,
+                              pool ? pool->size() : 1);
+
+    // Find the bounds of the centroids, so codes can use their full range.
+    std::vector<AABB> chunk_bounds(chunks);
+    runChunks(chunks, pool, [&](size_t c) {
+        size_t begin = c * chunk_size;
+        size_t end = std::min(prims.size(), begin + chunk_size);
+        Point3 min = prims[begin].centroid;
+        Point3 max = prims[begin].centroid;
+        for (size_t i = begin + 1; i < end; ++i) {
+            for (int axis = 0; axis < 3; ++axis) {
+                min[axis] = std::min(min[axis], prims[i].centroid[axis]);
+                max[axis] = std::max(max[axis], prims[i].centroid[axis]);
+            }
+        }
+        chunk_bounds[c] = AABB(min, max);
+    });
+    AABB centroid_bounds = chunk_bounds[0];
+    for (size_t c = 1; c < chunks; ++c) {
+        centroid_bounds = AABB::surroundingBox(centroid_bounds,
+                                               chunk_bounds[c]);
+    }
+
+    Vec3 extent = centroid_bounds.max() - centroid_bounds.min();
+    Vec3 inv_extent;
+    for (int axis = 0; axis < 3; ++axis) {
+        inv_extent[axis] = extent[axis] > 0 ? 1.0 / extent[axis] : 0.0;
+    }
+
+    std::vector<MortonPrimitive> codes(prims.size());
+    runChunks(chunks, pool, [&](size_t c) {
+        size_t end = std::min(prims.size(), (c + 1) * chunk_size);
+        for (size_t i = c * chunk_size; i < end; ++i) {
+            Vec3 offset = prims[i].centroid - centroid_bounds.min();
+            for (int axis = 0; axis < 3; ++axis) {
+                offset[axis] *= inv_extent[axis];
+            }
+            codes[i].code = mortonCode(offset);
+            codes[i].index = static_cast<uint32_t>(i);
+        }
+    });
+
+    radixSort(codes, pool);
+
+    std::vector<PrimitiveInfo> sorted(prims.size());
+    runChunks(chunks, pool, [&](size_t c) {
+        size_t end = std::min(prims.size(), (c + 1) * chunk_size);
+        for (size_t i = c * chunk_size; i < end; ++i) {
+            sorted[i] = prims[codes[i].index];
+        }
+    });
+    prims.swap(sorted);
+
+    buildMortonNode(prims, codes, 0, prims.size(), 0, max_leaf_size, nodes,
+                    pool);
+}
+
+} // namespace
+
+//-----------------------------------------------------------------------------
+// LinearBVH
+
+const uint32_t LinearBVH::kEmptySlot;
+
+void LinearBVH::build(const std::vector<AABB> & boxes, BVHSplitMethod method,
+                      size_t max_leaf_size, std::vector<uint32_t> & order) {
+    nodes_.clear();
+    order.clear();
+    if (boxes.empty()) return;
+
+    // Leaves store their size in 16 bits.
+    max_leaf_size = std::min<size_t>(max_leaf_size,
+                                     std::numeric_limits<uint16_t>::max());
+
+    std::vector<PrimitiveInfo> prims(boxes.size());
+    for (size_t i = 0; i < boxes.size(); ++i) {
+        prims[i].box = boxes[i];
+        prims[i].centroid = boxes[i].centroid();
+        prims[i].index = static_cast<uint32_t>(i);
+    }
+
+    // Big subtrees are built on other threads when there are any.
+    TaskPool * pool = &TaskPool::global();
+    if (pool->size() == 1) pool = nullptr;
+
+    // A binary tree over n primitives has at most 2n - 1 nodes.
+    nodes_.reserve(2 * boxes.size());
+    if (method == BVHSplitMethod::LBVH) {
+        buildMorton(prims, max_leaf_size, nodes_, pool);
+    }
+    else {
+        buildNode(prims, 0, prims.size(), 0, method, max_leaf_size, nodes_,
+                  pool);
+    }
+    nodes_.shrink_to_fit();
+
+    order.resize(prims.size());
+    bounds_ = prims[0].box;
+    for (size_t i = 0; i < prims.size(); ++i) {
+        order[i] = prims[i].index;
+        bounds_ = AABB::surroundingBox(bounds_, prims[i].box);
+    }
+}
+
+void LinearBVH::alignLeaves(uint32_t alignment,
+                            std::vector<uint32_t> & order) {
+    std::vector<uint32_t> aligned;
+    aligned.reserve(order.size() + order.size() / 2);
+
+    // Leaves are in depth-first order, which is also the order of their
+    // primitive ranges, so the ranges can be copied over one by one.
+    for (auto & node : nodes_) {
+        if (node.num_primitives == 0) continue;
+        while (aligned.size() % alignment != 0) {
+            aligned.push_back(kEmptySlot);
+        }
+        uint32_t first = node.primitives_offset;
+        node.primitives_offset = static_cast<uint32_t>(aligned.size());
+        aligned.insert(aligned.end(), order.begin() + first,
+                       order.begin() + first + node.num_primitives);
+    }
+    while (aligned.size() % alignment != 0) {
+        aligned.push_back(kEmptySlot);
+    }
+    order.swap(aligned);
+}
+
+bool LinearBVH::boundingBox(AABB & box) const {
+    if (nodes_.empty()) return false;
+    box = bounds_;
+    return true;
+}
+
+} // namespace rudnick_rt
@@ -7,22 +7,29 @@
  * For CS 419 at the University of Illinois at Urbana-Champaign.
  */
 #include <iostream>
+#include <chrono>
 #include <cmath>
-#include <ctime>
 #include <string>
+#include <vector>
 
+#include "accumulation_buffer.h"
 #include "png.h"
+#include "renderer.h"
 #include "rgba_pixel.h"
 
 #include "aa_rectangle.h"
 #include "camera.h"
 #include "hittable.h"
 #include "hittable_list.h"
+#include "light_list.h"
 #include "material.h"
+#include "path_tracer.h"
 #include "ray.h"
 #include "rrt_enum.h"
+#include "sampler.h"
 #include "scene_presets.h"
 #include "sphere.h"
+#include "thread_pool.h"
 #include "utils.h"
 #include "vec3.h"
 
@@ -31,31 +38,29 @@ using namespace rudnick_rt;
 
 namespace rudnick_rt {
 
-typedef struct {
-    double x, y;
-} Point2;
-
 /**
  * Non-recursive helper function to trace a ray and determine what color it
  * hits.
  * @param ray The ray to trace.
  * @param background The background color.
  * @param world The scene to render and check for ray intersections.
+ * @param sampler Where to draw the random numbers from.
  * @return The RGBColor to use to color the pixel.
  */
 RGBColor traceRayPhong(const Ray & ray, const RGBColor & background,
-                  const Hittable & world) {
+                  const Hittable & world, Sampler & sampler) {
     // Put a point light source at (8, 8, 8)
     Point3 light_source(7, 10, 4);
     // Record what the ray hits
     hit_record record;
     
     // If the ray hit something, do basic diffuse lighting
-    if (world.hit(ray, 0.001, infinity, record)) {
+    if (world.hitSurface(ray, 0.001, infinity, record)) {
         // Get the color of the object we hit
         RGBColor object_color;
         Ray scattered;
-        record.material->scatter(ray, record, object_color, scattered);
+        record.material->scatter(ray, record, object_color, scattered,
+                                 sampler);
 
         // Ambient weighting is constant.
         auto ambient_weight = 0.1;
@@ -99,9 +104,11 @@ RGBColor traceRayPhong(const Ray & ray, const RGBColor & background,
  * @param ray The ray to trace.
  * @param world The scene to render and check for ray intersections.
  * @param depth The max recursion depth/number of ray bounces.
+ * @param sampler Where to draw the random numbers from.
  * @return The RGBColor to use to color the pixel.
  */
-RGBColor traceRayRecursive(const Ray & ray, const Hittable & world, int depth) {
+RGBColor traceRayRecursive(const Ray & ray, const Hittable & world, int depth,
+                           Sampler & sampler) {
     // Record what the ray hits
     hit_record record;
 
@@ -112,11 +119,13 @@ RGBColor traceRayRecursive(const Ray & ray, const Hittable & world, int depth) {
 
     // If the ray hits anything, shoot a new ray in a random direction, and
     // color based on the new ray
-    if (world.hit(ray, 0.001, infinity, record)) {
+    if (world.hitSurface(ray, 0.001, infinity, record)) {
         Ray scattered;
         RGBColor attenuation;
-        if (record.material->scatter(ray, record, attenuation, scattered)) {
-            return attenuation * traceRayRecursive(scattered, world, depth - 1);
+        if (record.material->scatter(ray, record, attenuation, scattered,
+                                     sampler)) {
+            return attenuation * traceRayRecursive(scattered, world, depth - 1,
+                                                   sampler);
         }
         return RGBColor(0, 0, 0);
     }
@@ -135,10 +144,12 @@ RGBColor traceRayRecursive(const Ray & ray, const Hittable & world, int depth) {
  * @param background The background color.
  * @param world The scene to render and check for ray intersections.
  * @param depth The max recursion depth/number of ray bounces.
+ * @param sampler Where to draw the random numbers from.
  * @return The RGBColor to use to color the pixel.
  */
 RGBColor traceRayRecursive(const Ray & ray, const RGBColor & background,
-                           const Hittable & world, int depth) {
+                           const Hittable & world, int depth,
+                           Sampler & sampler) {
     hit_record record;
 
     // Limit the maximum number of bounces
@@ -146,64 +157,21 @@ RGBColor traceRayRecursive(const Ray & ray, const RGBColor & background,
         return RGBColor(0, 0, 0);
 
     // If the ray doesn't hit anything, color it with the background color
-    if (!world.hit(ray, 0.001, infinity, record)) 
+    if (!world.hitSurface(ray, 0.001, infinity, record)) 
         return background;
 
     Ray scattered;
     RGBColor attenuation;
     RGBColor emitted = record.material->emitted(0, 0, record.point);
 
-    if (!record.material->scatter(ray, record, attenuation, scattered))
+    if (!record.material->scatter(ray, record, attenuation, scattered, sampler))
         return emitted;
 
-    return emitted +
-        attenuation * traceRayRecursive(scattered, background, world, depth-1);
+    return emitted + attenuation
+        * traceRayRecursive(scattered, background, world, depth-1, sampler);
 }
 
 
-/**
- * Creates an array of sample points for multi-jittered sampling.
- * @param p array of point2s; must have cols*rows cells
- * @param cols number of columns
- * @param rows number of rows
- */
-void multiJitter(Point2 p[], int cols, int rows) {
-    auto subcell_width = 1.0 / (cols * rows);
-
-    // Initialize the array to the canonical multi-jittered pattern.
-    for (int i = 0; i < cols; ++i) {
-        for (int j = 0; j < rows; ++j) {
-            
-            p[i*rows + j].x = i*rows*subcell_width + j*subcell_width
-                + randomDouble(0, subcell_width);
-            p[i*rows + j].y = j*cols*subcell_width + i*subcell_width
-                + randomDouble(0, subcell_width);
-        }
-    }
-
-    // Shuffle x-coordinates within each column of cells.
-    for (int i = 0; i < cols; ++i) {
-        for (int j = 0; j < rows; ++j) {
-            
-            auto k = randomInt(j, rows-1);
-            auto t = p[i*rows + j].x;
-            p[i*rows + j].x = p[i*rows + k].x;
-            p[i*rows + k].x = t;
-        }
-    }
-
-    // Shuffle y-coordinates within each row of cells.
-    for (int i = 0; i < rows; ++i) {
-        for (int j = 0; j < cols; ++j) {
-            
-            auto k = randomInt(j, cols-1);
-            auto t = p[j*rows + i].x;
-            p[j*rows + i].y = p[k*rows + i].y;
-            p[k*rows + i].y = t;
-        }
-    }
-}
-
 } // namespace rudnick_rt
 
 
@@ -218,17 +186,23 @@ int main() {
     std::cin >> render_name;
     std::cout << "Rendering " << render_name << ".png" << std::endl;
 
-    // Start a timer to time the rendering process.
-    std::clock_t start;
-    double duration;
-    start = std::clock();
+    // Start a timer to time the rendering process. This measures wall-clock
+    // time, since CPU time adds up the time spent on every thread.
+    auto start = std::chrono::steady_clock::now();
+    std::chrono::duration<double> duration;
 
     // Set up image
     const auto aspect_ratio = 16.0/9.0;
     const int image_width = 640;
     const int image_height = static_cast<int>(image_width / aspect_ratio);
-    const int samples_per_pixel = 100;  // MUST BE A SQUARE NUMBER
-    const int max_depth = 400;
+    const int samples_per_pixel = 100;  // most any pixel gets
+    const int min_samples = 16;
+    const double error_threshold = 0.03;
+    const double time_budget = 0;  // seconds, or 0 for no limit
+    const double snapshot_interval = 30;  // seconds, or 0 for no snapshots
+    const double checkpoint_interval = 60;  // seconds, or 0 for none
+    const int min_bounces = 3;
+    const int max_bounces = 400;
     PNG *render = new PNG(image_width, image_height);
     RGBColor background(0.2, 0.8, 1.0);
 
@@ -239,8 +213,8 @@ int main() {
     // Print performance info
     std::cout << "Image dimensions: " << image_width << "x" << image_height << "\n";
     std::cout << "Number of primitives: " << world.objects_.size() << "\n";
-    duration = (std::clock() - start) / (double) CLOCKS_PER_SEC;
-    std::cout << "Time to load scene: " << duration << " seconds\n";
+    duration = std::chrono::steady_clock::now() - start;
+    std::cout << "Time to load scene: " << duration.count() << " seconds\n";
 
     // Set up camera
     //Point3 camera_pos = Point3(-8, 15, -5); // who knows what
@@ -255,49 +229,64 @@ int main() {
     
     Camera cam(camera_pos, lookat, up, fov, aspect_ratio, aperture, focal_distance);
 
-    // Set up a multi-jitter sample pattern
-    auto sample_pattern_rows = std::sqrt(samples_per_pixel);
-    Point2 sample_pattern[samples_per_pixel];
-    multiJitter(sample_pattern, sample_pattern_rows, sample_pattern_rows);
+    // Every pixel gets its own scrambled Sobol points, and so does every
+    // dimension of the path: the pixel offset, the lens and each bounce.
+    SobolSampler sampler;
+
+    // Paths are traced in a loop, and ended with Russian roulette once
+    // they've bounced min_bounces times. The scene's lights are sampled
+    // directly at every diffuse hit.
+    LightList lights(world);
+    std::cout << "Number of lights: " << lights.size() << "\n";
+    PathTracer integrator(RGBColor(0, 0, 0), lights, min_bounces, max_bounces);
 
     // Render the image!
-    // Loop over each row of pixels (scanline)
-    for (int y = 0; y < image_height; ++y) {
-        // Show the progress on the console
-        std::cout << "\rScanlines remaining: " << image_height - y << ' ' << std::flush;
-        
-        // For each pixel in the row
-        for (int x = 0; x < image_width; ++x) {
-    
-            // Get the pixel color, with antialiasing
-            RGBColor pixel_color(0, 0, 0);
-            for (int s = 0; s < samples_per_pixel; ++s) {
-                auto u = (x + sample_pattern[s].x) / (image_width - 1);
-                auto v = (y + sample_pattern[s].y) / (image_height - 1);
-                Ray ray = cam.getRay(u, v, projection);
-                // Accumulate the pixel color from samples
-                //pixel_color += traceRayPhong(ray, background, world);
-                pixel_color += traceRayRecursive(ray, RGBColor(0, 0, 0), world, max_depth);
-            }
-            // Divide the accumulated color by the number of accumulations
-            pixel_color = pixel_color / samples_per_pixel;
-
-            /**
-             * Get the pixel in the PNG and set it to the right color.
-             * Note (0,0) is the upper-left corner of the png file, but the
-             * lower-left corner of the renderer's coordinates, so we have to
-             * flip the y-coordinate
-             */
-            RGBAPixel& pixel = render->getPixel(x, image_height - 1 - y);
-            pixel.setColor(pixel_color);
-        }
+    // Each call traces one sample of one pixel. The renderer splits the
+    // image into tiles and traces them on every core.
+    auto trace_sample = [&](int x, int y, Sampler & sampler) -> RGBColor {
+        Point2 offset = sampler.get2D();
+        auto u = (x + offset.x) / (image_width - 1);
+        auto v = (y + offset.y) / (image_height - 1);
+        Ray ray = cam.getRay(u, v, projection, sampler);
+        //return traceRayPhong(ray, background, world, sampler);
+        return integrator.trace(ray, world, sampler);
+    };
+    // Tiles get more samples until they stop looking noisy.
+    Renderer renderer(image_width, image_height, samples_per_pixel);
+    renderer.setAdaptive(min_samples, error_threshold);
+    renderer.setTimeBudget(time_budget);
+
+    // The image is rendered in passes, and the PNG gets rewritten with the
+    // image so far every snapshot_interval seconds.
+    std::string render_file = "renders/" + render_name + ".png";
+    renderer.setSnapshots(render_file, snapshot_interval);
+
+    // If a render with this name got stopped, pick up where it left off.
+    std::string checkpoint_file = "renders/" + render_name + ".checkpoint";
+    renderer.setCheckpoints(checkpoint_file, checkpoint_interval);
+    AccumulationBuffer film(image_width, image_height);
+    if (renderer.loadCheckpoint(checkpoint_file, sampler, film)) {
+        std::cout << "Resuming from " << checkpoint_file << " with "
+                  << film.totalSamples() << " samples\n";
     }
-
-    render->writeToFile("renders/" + render_name + ".png");
+    auto render_seconds = renderer.render(trace_sample, sampler, film);
+    film.toPNG(*render);
+
+    // Print the render throughput
+    double total_samples = renderer.samplesTraced();
+    std::cout << "Average samples per pixel: "
+              << 1.0 * film.totalSamples() / (image_width * image_height)
+              << "\n";
+    std::cout << "Time to render: " << render_seconds << " seconds on "
+              << ThreadPool::global().size() << " threads\n";
+    std::cout << "Throughput: " << total_samples / render_seconds / 1e6
+              << " million samples per second\n";
+
+    render->writeToFile(render_file);
     delete render;
-    std::cout << "Image saved as renders/" << render_name << ".png\n";
-    duration = (std::clock() - start) / (double) CLOCKS_PER_SEC;
-    std::cout << "Total rendering time: " << duration << "\n";
+    std::cout << "Image saved as " << render_file << "\n";
+    duration = std::chrono::steady_clock::now() - start;
+    std::cout << "Total rendering time: " << duration.count() << " seconds\n";
 
     std::cout << "Done!\n";
     return 0;
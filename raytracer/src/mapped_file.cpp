@@ -0,0 +1,69 @@
+/**
+ * @file mapped_file.cpp
+ * @author Ian Rudnick
+ * Implementation of the read-only file view.
+ */
+#include "mapped_file.h"
+
+#ifdef WIN32
+#include <cstdio>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace rudnick_rt {
+
+#ifdef WIN32
+
+MappedFile::MappedFile(const std::string & filename)
+    : data_(nullptr), size_(0) {
+    std::FILE * file = std::fopen(filename.c_str(), "rb");
+    if (!file) return;
+    if (std::fseek(file, 0, SEEK_END) == 0) {
+        long size = std::ftell(file);
+        if (size > 0 && std::fseek(file, 0, SEEK_SET) == 0) {
+            buffer_.resize(static_cast<size_t>(size));
+            if (std::fread(buffer_.data(), 1, buffer_.size(), file)
+                == buffer_.size()) {
+                data_ = buffer_.data();
+                size_ = buffer_.size();
+            }
+        }
+    }
+    std::fclose(file);
+}
+
+MappedFile::~MappedFile() {}
+
+#else
+
+MappedFile::MappedFile(const std::string & filename)
+    : data_(nullptr), size_(0) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return;
+
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        size_t size = static_cast<size_t>(info.st_size);
+        void * map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            data_ = static_cast<const char *>(map);
+            size_ = size;
+        }
+    }
+    // The mapping stays valid after the file is closed.
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (data_) {
+        munmap(const_cast<char *>(data_), size_);
+    }
+}
+
+#endif
+
+} // namespace rudnick_rt
@@ -11,15 +11,19 @@
 
 #include "hittable.h"
 #include "ray.h"
+#include "sampler.h"
+#include "utils.h"
 #include "vec3.h"
 
 namespace rudnick_rt {
 
 bool BasicLambertian::scatter(const Ray & incident, const hit_record & record,
-                         RGBColor & attenuation, Ray & scattered) const {
+                         RGBColor & attenuation, Ray & scattered,
+                         Sampler & sampler) const {
     
-    Point3 target = record.point + Vec3::randomInHemisphere(record.normal);
-    auto scatter_direction = target - record.point;
+    // A random point on the unit sphere around the normal's tip gives a
+    // cosine-weighted direction.
+    auto scatter_direction = record.normal + sampleUnitSphere(sampler.get2D());
 
     // Prevent degenerate scatter direction
     if (scatter_direction.nearZero())
@@ -31,13 +35,31 @@ bool BasicLambertian::scatter(const Ray & incident, const hit_record & record,
 }
 
 
+RGBColor BasicLambertian::evaluate(const Ray & incident,
+                                   const hit_record & record,
+                                   const Vec3 & direction) const {
+    auto cosine = Vec3::dot(record.normal, Vec3::normalize(direction));
+    return cosine > 0 ? albedo_ * (cosine / pi) : RGBColor(0, 0, 0);
+}
+
+
+double BasicLambertian::scatteringPdf(const Ray & incident,
+                                      const hit_record & record,
+                                      const Vec3 & direction) const {
+    auto cosine = Vec3::dot(record.normal, Vec3::normalize(direction));
+    return cosine > 0 ? cosine / pi : 0;
+}
+
+
 bool BasicMetal::scatter(const Ray & incident, const hit_record & record,
-                         RGBColor & attenuation, Ray & scattered) const {
+                         RGBColor & attenuation, Ray & scattered,
+                         Sampler & sampler) const {
     
     Vec3 reflect_direction=Vec3::reflect(Vec3::normalize(incident.direction()),
                                          record.normal);
                                          
-    Vec3 fuzz = fuzziness_ * Vec3::randomInUnitSphere();
+    Point2 direction = sampler.get2D();
+    Vec3 fuzz = fuzziness_ * sampleUnitBall(direction, sampler.get1D());
     scattered = Ray(record.point, reflect_direction + fuzz);
     attenuation = albedo_;
     return (Vec3::dot(scattered.direction(), record.normal) > 0);
@@ -45,8 +67,12 @@ bool BasicMetal::scatter(const Ray & incident, const hit_record & record,
 
 
 bool BasicDielectric::scatter(const Ray & incident, const hit_record & record,
-                         RGBColor & attenuation, Ray & scattered) const {
+                         RGBColor & attenuation, Ray & scattered,
+                         Sampler & sampler) const {
 
+    // Draw the number even when it isn't needed, so every hit on this
+    // material uses the same dimensions.
+    double choice = sampler.get1D();
     double refraction_ratio = record.hit_front_of_surface ? (1.0 / ri_) : ri_;
 
     Vec3 in_normal = Vec3::normalize(incident.direction());
@@ -57,7 +83,7 @@ bool BasicDielectric::scatter(const Ray & incident, const hit_record & record,
     //bool cannot_refract = refraction_ratio * sin_theta > 1.0;
 
     if ( (refraction_ratio * sin_theta > 1.0) ||
-         (reflectance(cos_theta, refraction_ratio) > randomDouble())
+         (reflectance(cos_theta, refraction_ratio) > choice)
        ) {
 
         out_direction = Vec3::reflect(in_normal, record.normal);
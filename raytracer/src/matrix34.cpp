@@ -0,0 +1,125 @@
+/**
+ * @file matrix34.cpp
+ * @author Ian Rudnick
+ * Implementation of the 3x4 affine transformation matrix.
+ */
+#include "matrix34.h"
+
+#include <cmath>
+
+#include "utils.h"
+
+namespace rudnick_rt {
+
+Matrix34::Matrix34() {
+    for (int r = 0; r < 3; ++r) {
+        for (int c = 0; c < 4; ++c) {
+            m_[r][c] = r == c ? 1.0 : 0.0;
+        }
+    }
+}
+
+
+Matrix34 Matrix34::translation(const Vec3 & displacement) {
+    Matrix34 result;
+    for (int r = 0; r < 3; ++r) {
+        result.m_[r][3] = displacement[r];
+    }
+    return result;
+}
+
+
+Matrix34 Matrix34::rotation(const Vec3 & axis, double angle) {
+    // Rodrigues' rotation formula.
+    Vec3 a = Vec3::normalize(axis);
+    double radians = degToRad(angle);
+    double s = std::sin(radians);
+    double c = std::cos(radians);
+    double t = 1 - c;
+
+    Matrix34 result;
+    result.m_[0][0] = t*a[0]*a[0] + c;
+    result.m_[0][1] = t*a[0]*a[1] - s*a[2];
+    result.m_[0][2] = t*a[0]*a[2] + s*a[1];
+    result.m_[1][0] = t*a[0]*a[1] + s*a[2];
+    result.m_[1][1] = t*a[1]*a[1] + c;
+    result.m_[1][2] = t*a[1]*a[2] - s*a[0];
+    result.m_[2][0] = t*a[0]*a[2] - s*a[1];
+    result.m_[2][1] = t*a[1]*a[2] + s*a[0];
+    result.m_[2][2] = t*a[2]*a[2] + c;
+    return result;
+}
+
+
+Matrix34 Matrix34::scaling(const Vec3 & factors) {
+    Matrix34 result;
+    for (int r = 0; r < 3; ++r) {
+        result.m_[r][r] = factors[r];
+    }
+    return result;
+}
+
+
+Matrix34 operator*(const Matrix34 & a, const Matrix34 & b) {
+    Matrix34 result;
+    for (int r = 0; r < 3; ++r) {
+        for (int c = 0; c < 4; ++c) {
+            // b's missing bottom row is 0 0 0 1.
+            result.m_[r][c] = a.m_[r][0]*b.m_[0][c] + a.m_[r][1]*b.m_[1][c]
+                            + a.m_[r][2]*b.m_[2][c];
+        }
+        result.m_[r][3] += a.m_[r][3];
+    }
+    return result;
+}
+
+
+Matrix34 Matrix34::inverse() const {
+    // Invert the 3x3 part with its adjugate.
+    Matrix34 result;
+    result.m_[0][0] = m_[1][1]*m_[2][2] - m_[1][2]*m_[2][1];
+    result.m_[0][1] = m_[0][2]*m_[2][1] - m_[0][1]*m_[2][2];
+    result.m_[0][2] = m_[0][1]*m_[1][2] - m_[0][2]*m_[1][1];
+    result.m_[1][0] = m_[1][2]*m_[2][0] - m_[1][0]*m_[2][2];
+    result.m_[1][1] = m_[0][0]*m_[2][2] - m_[0][2]*m_[2][0];
+    result.m_[1][2] = m_[0][2]*m_[1][0] - m_[0][0]*m_[1][2];
+    result.m_[2][0] = m_[1][0]*m_[2][1] - m_[1][1]*m_[2][0];
+    result.m_[2][1] = m_[0][1]*m_[2][0] - m_[0][0]*m_[2][1];
+    result.m_[2][2] = m_[0][0]*m_[1][1] - m_[0][1]*m_[1][0];
+
+    double det = m_[0][0]*result.m_[0][0] + m_[0][1]*result.m_[1][0]
+               + m_[0][2]*result.m_[2][0];
+    double inv_det = 1.0 / det;
+    for (int r = 0; r < 3; ++r) {
+        for (int c = 0; c < 3; ++c) {
+            result.m_[r][c] *= inv_det;
+        }
+    }
+
+    // Then undo the translation in the rotated frame.
+    for (int r = 0; r < 3; ++r) {
+        result.m_[r][3] = -(result.m_[r][0]*m_[0][3] + result.m_[r][1]*m_[1][3]
+                            + result.m_[r][2]*m_[2][3]);
+    }
+    return result;
+}
+
+
+AABB Matrix34::transformBox(const AABB & box) const {
+    // Each output axis is a sum of one term per input axis, so its extremes
+    // come from picking the smaller or larger end of each term separately.
+    // This gives the same box as transforming all eight corners.
+    Point3 min, max;
+    for (int r = 0; r < 3; ++r) {
+        min[r] = max[r] = m_[r][3];
+        for (int c = 0; c < 3; ++c) {
+            double a = m_[r][c] * box.min()[c];
+            double b = m_[r][c] * box.max()[c];
+            min[r] += a < b ? a : b;
+            max[r] += a < b ? b : a;
+        }
+    }
+    return AABB(min, max);
+}
+
+} // namespace rudnick_rt
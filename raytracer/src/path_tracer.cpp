@@ -0,0 +1,120 @@
+/**
+ * @file path_tracer.cpp
+ * @author Ian Rudnick
+ * Implementation of the iterative path tracing integrator.
+ */
+#include "path_tracer.h"
+
+#include <algorithm>
+
+#include "material.h"
+#include "utils.h"
+
+namespace rudnick_rt {
+
+constexpr double PathTracer::kMaxSurvivalProbability;
+
+PathTracer::PathTracer(const RGBColor & background, const LightList & lights,
+                       int min_bounces, int max_bounces)
+    : background_(background),
+      lights_(lights),
+      min_bounces_(min_bounces),
+      max_bounces_(max_bounces) {}
+
+RGBColor PathTracer::trace(const Ray & ray, const Hittable & world,
+                           Sampler & sampler) const {
+    RGBColor radiance(0, 0, 0);
+    RGBColor throughput(1, 1, 1);
+    Ray current = ray;
+
+    // Whether the last bounce already sampled the lights directly, and the
+    // density it picked the current ray's direction with.
+    bool sampled_lights = false;
+    double scattering_pdf = 0;
+    Point3 last_point;
+
+    for (int bounce = 0; bounce < max_bounces_; ++bounce) {
+        hit_record record;
+
+        // If the ray doesn't hit anything, it picks up the background color
+        if (!world.hitSurface(current, 0.001, infinity, record)) {
+            radiance += throughput * background_;
+            break;
+        }
+
+        if (record.material->isEmissive()) {
+            RGBColor emitted = record.material->emitted(0, 0, record.point);
+            // Light sampling could also have found this emitter, so share
+            // the credit with it.
+            if (sampled_lights) {
+                double light_pdf =
+                    lights_.pdfValue(last_point, current.direction());
+                emitted *= powerHeuristic(scattering_pdf, light_pdf);
+            }
+            radiance += throughput * emitted;
+        }
+
+        Ray scattered;
+        RGBColor attenuation;
+        if (!record.material->scatter(current, record, attenuation, scattered,
+                                      sampler))
+            break;
+
+        sampled_lights = record.material->isDiffuse() && !lights_.empty();
+        if (sampled_lights) {
+            radiance += throughput * sampleLight(current, record, world, sampler);
+            scattering_pdf = record.material->scatteringPdf(
+                current, record, scattered.direction());
+            last_point = record.point;
+        }
+        throughput = throughput * attenuation;
+
+        // Russian roulette: end dim paths early, and boost the ones that
+        // survive by the same odds so the expected value doesn't change.
+        if (bounce + 1 >= min_bounces_) {
+            double survival = std::min(
+                std::max(throughput.x(), std::max(throughput.y(),
+                                                  throughput.z())),
+                kMaxSurvivalProbability);
+            if (sampler.get1D() >= survival)
+                break;
+            throughput /= survival;
+        }
+
+        current = scattered;
+    }
+    return radiance;
+}
+
+RGBColor PathTracer::sampleLight(const Ray & incident,
+                                 const hit_record & record,
+                                 const Hittable & world,
+                                 Sampler & sampler) const {
+    const Hittable & light = lights_.pick(sampler);
+    Vec3 direction = light.random(record.point, sampler);
+    double light_pdf = lights_.pdfValue(record.point, direction);
+    if (light_pdf <= 0)
+        return RGBColor(0, 0, 0);
+
+    // Skip the shadow ray if the surface doesn't reflect this direction.
+    RGBColor reflected = record.material->evaluate(incident, record, direction);
+    if (reflected.nearZero())
+        return RGBColor(0, 0, 0);
+
+    // Take whatever the direction reaches first. That can be a different
+    // emitter than the one picked, in front of it, which is fine: light_pdf
+    // is the density of the whole mixture, the same one the BSDF-sampled
+    // bounce weighs its emitter hits with.
+    Ray to_light(record.point, direction);
+    hit_record light_record;
+    if (!world.hitSurface(to_light, 0.001, infinity, light_record) ||
+        !light_record.material->isEmissive())
+        return RGBColor(0, 0, 0);
+
+    RGBColor emitted = light_record.material->emitted(0, 0, light_record.point);
+    double pdf = record.material->scatteringPdf(incident, record, direction);
+    return reflected * emitted
+        * (powerHeuristic(light_pdf, pdf) / light_pdf);
+}
+
+} // namespace rudnick_rt
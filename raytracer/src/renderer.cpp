@@ -0,0 +1,279 @@
+/**
+ * @file renderer.cpp
+ * @author Ian Rudnick
+ * Implementation of the tile-based multithreaded renderer.
+ */
+#include "renderer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "png.h"
+#include "rng.h"
+#include "utils.h"
+
+namespace rudnick_rt {
+
+Renderer::Renderer(int image_width, int image_height, int samples_per_pixel,
+                   int tile_size, uint64_t seed)
+    : image_width_(image_width),
+      image_height_(image_height),
+      samples_per_pixel_(samples_per_pixel),
+      tile_size_(tile_size),
+      seed_(seed),
+      min_samples_(samples_per_pixel) {
+
+    // Round up so the tiles on the right and top edges cover the remainder.
+    tiles_x_ = (image_width_ + tile_size_ - 1) / tile_size_;
+    tiles_y_ = (image_height_ + tile_size_ - 1) / tile_size_;
+}
+
+void Renderer::setAdaptive(int min_samples, double error_threshold) {
+    if (error_threshold <= 0) {
+        min_samples_ = samples_per_pixel_;
+        error_threshold_ = 0;
+        return;
+    }
+    // The variance needs at least two samples.
+    min_samples_ = std::max(2, std::min(min_samples, samples_per_pixel_));
+    error_threshold_ = error_threshold;
+}
+
+double Renderer::render(const SampleFunction & trace, const Sampler & sampler,
+                        AccumulationBuffer & film, ThreadPool & pool) {
+    start_ = std::chrono::steady_clock::now();
+    uint64_t samples_before = film.totalSamples();
+
+    std::vector<int> active;
+    for (int tile = 0; tile < numTiles(); ++tile) {
+        if (needsMoreSamples(tile, film))
+            active.push_back(tile);
+    }
+
+    // Tiles write into the buffer under film_mutex, so snapshots and
+    // checkpoints never see half of a tile.
+    std::mutex film_mutex;
+    std::mutex print_mutex;
+    uint64_t key = checkpointKey(sampler);
+    auto write_snapshot = [&]() {
+        PNG image(image_width_, image_height_);
+        {
+            std::lock_guard<std::mutex> film_lock(film_mutex);
+            film.toPNG(image);
+        }
+        image.writeToFile(snapshot_filename_);
+    };
+    auto write_checkpoint = [&]() {
+        AccumulationBuffer copy(image_width_, image_height_);
+        {
+            std::lock_guard<std::mutex> film_lock(film_mutex);
+            copy = film;
+        }
+        if (!copy.save(checkpoint_filename_, key)) {
+            std::lock_guard<std::mutex> lock(print_mutex);
+            std::cerr << "\nCouldn't save the checkpoint to "
+                      << checkpoint_filename_ << std::endl;
+        }
+    };
+
+    // Calls write every interval seconds. Only one thread writes each kind
+    // of file at a time; the others just carry on.
+    struct Periodic {
+        std::mutex mutex;
+        double last = 0;
+    } snapshots, checkpoints;
+    auto every = [&](Periodic & periodic, double interval,
+                     const std::function<void()> & write) {
+        if (interval <= 0)
+            return;
+        std::unique_lock<std::mutex> lock(periodic.mutex, std::try_to_lock);
+        if (!lock || elapsed() - periodic.last < interval)
+            return;
+        write();
+        periodic.last = elapsed();
+    };
+
+    std::cout << "Rendering " << numTiles() << " tiles on " << pool.size()
+              << " threads" << std::endl;
+
+    for (int pass = 1; !active.empty(); ++pass) {
+        std::cout << "Pass " << pass << ": " << active.size() << " tiles"
+                  << std::endl;
+
+        std::atomic<int> tiles_done(0);
+        pool.parallelFor(active.size(), [&](size_t i) {
+            std::unique_ptr<Sampler> tile_sampler = sampler.clone();
+            renderTile(active[i], trace, *tile_sampler, film, film_mutex);
+            every(snapshots, snapshot_interval_, write_snapshot);
+            every(checkpoints, checkpoint_interval_, write_checkpoint);
+
+            // Show the progress on the console
+            int done = ++tiles_done;
+            std::lock_guard<std::mutex> lock(print_mutex);
+            std::cout << "\rTiles remaining: " << active.size() - done
+                      << "    " << std::flush;
+        });
+        std::cout << "\n";
+        if (outOfTime()) {
+            std::cout << "Out of time; stopping with the samples so far"
+                      << std::endl;
+            break;
+        }
+
+        // Keep going on the tiles that still need samples.
+        std::vector<int> still_active;
+        for (int tile : active) {
+            if (needsMoreSamples(tile, film))
+                still_active.push_back(tile);
+        }
+        active.swap(still_active);
+    }
+
+    // Save what there is to resume from, or clean up once there's nothing
+    // left to resume.
+    if (checkpoint_interval_ > 0) {
+        if (active.empty())
+            std::remove(checkpoint_filename_.c_str());
+        else
+            write_checkpoint();
+    }
+
+    samples_traced_ = film.totalSamples() - samples_before;
+    return elapsed();
+}
+
+bool Renderer::loadCheckpoint(const std::string & filename,
+                              const Sampler & sampler,
+                              AccumulationBuffer & film) const {
+    return film.load(filename, checkpointKey(sampler));
+}
+
+uint64_t Renderer::checkpointKey(const Sampler & sampler) const {
+    // 64-bit FNV-1a over the settings, one after another.
+    uint64_t hash = 14695981039346656037ull;
+    auto add = [&hash](const void * data, size_t size) {
+        const unsigned char * bytes = static_cast<const unsigned char *>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+    };
+    add(&image_width_, sizeof(image_width_));
+    add(&image_height_, sizeof(image_height_));
+    add(&samples_per_pixel_, sizeof(samples_per_pixel_));
+    add(&tile_size_, sizeof(tile_size_));
+    add(&seed_, sizeof(seed_));
+    add(&min_samples_, sizeof(min_samples_));
+    add(&error_threshold_, sizeof(error_threshold_));
+    add(sampler.name(), std::strlen(sampler.name()));
+    return hash;
+}
+
+void Renderer::renderTile(int tile, const SampleFunction & trace,
+                          Sampler & sampler, AccumulationBuffer & film,
+                          std::mutex & film_mutex) const {
+    int x0, y0, x1, y1;
+    tileBounds(tile, x0, y0, x1, y1);
+    int width = x1 - x0;
+
+    // Add the samples to a copy of the tile, so the lock is only held while
+    // copying it back. No other thread writes to these pixels.
+    std::vector<AccumulationBuffer::Pixel> pixels;
+    pixels.reserve(width * (y1 - y0));
+    for (int y = y0; y < y1; ++y) {
+        for (int x = x0; x < x1; ++x)
+            pixels.push_back(film.at(x, y));
+    }
+    uint32_t fewest_samples = pixels[0].samples;
+    for (const AccumulationBuffer::Pixel & pixel : pixels)
+        fewest_samples = std::min(fewest_samples, pixel.samples);
+    bool first_pass = fewest_samples == 0;
+    int end_sample = first_pass
+        ? 1 : std::min(2 * int(fewest_samples), samples_per_pixel_);
+
+    RNG & rng = threadRNG();
+    int rows_done = 0;
+    for (int y = y0; y < y1; ++y, ++rows_done) {
+        // Stop partway when the time is up, but keep the finished rows.
+        if (!first_pass && outOfTime())
+            break;
+
+        for (int x = x0; x < x1; ++x) {
+            AccumulationBuffer::Pixel & pixel =
+                pixels[(y - y0) * width + (x - x0)];
+            uint64_t pixel_index = uint64_t(y) * image_width_ + x;
+            for (int s = pixel.samples; s < end_sample; ++s) {
+                rng.seedSample(pixel_index, s, seed_);
+                sampler.startSample(pixel_index, s, seed_);
+                pixel.add(trace(x, y, sampler));
+            }
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(film_mutex);
+    for (int y = y0; y < y0 + rows_done; ++y) {
+        for (int x = x0; x < x1; ++x)
+            film.at(x, y) = pixels[(y - y0) * width + (x - x0)];
+    }
+}
+
+bool Renderer::needsMoreSamples(int tile,
+                                const AccumulationBuffer & film) const {
+    int x0, y0, x1, y1;
+    tileBounds(tile, x0, y0, x1, y1);
+
+    // Error estimates are only compared once the whole tile has finished a
+    // pass, so a stopped and resumed render decides the same way.
+    int samples = film.at(x0, y0).samples;
+    for (int y = y0; y < y1; ++y) {
+        for (int x = x0; x < x1; ++x) {
+            if (film.at(x, y).samples != uint32_t(samples))
+                return true;
+        }
+    }
+    if (samples < min_samples_)
+        return true;
+    return samples < samples_per_pixel_
+        && tileError(tile, film) > error_threshold_;
+}
+
+double Renderer::tileError(int tile, const AccumulationBuffer & film) const {
+    int x0, y0, x1, y1;
+    tileBounds(tile, x0, y0, x1, y1);
+
+    // Use the worst pixel, not the average, so a few fireflies or a small
+    // caustic keep the tile going even when the rest of it is clean.
+    double max_error = 0;
+    for (int y = y0; y < y1; ++y) {
+        for (int x = x0; x < x1; ++x) {
+            const AccumulationBuffer::Pixel & pixel = film.at(x, y);
+            double mean = AccumulationBuffer::luminanceOf(pixel.mean());
+            double std_error = pixel.luminanceError();
+
+            // Measure the error after gamma correction, the way the pixel
+            // is written out, so dark noise counts for more than bright.
+            double error = std::sqrt(clamp(mean + std_error, 0.0, 1.0))
+                         - std::sqrt(clamp(mean, 0.0, 1.0));
+            max_error = std::max(max_error, error);
+        }
+    }
+    return max_error;
+}
+
+void Renderer::tileBounds(int tile, int & x0, int & y0,
+                          int & x1, int & y1) const {
+    x0 = (tile % tiles_x_) * tile_size_;
+    y0 = (tile / tiles_x_) * tile_size_;
+    x1 = std::min(x0 + tile_size_, image_width_);
+    y1 = std::min(y0 + tile_size_, image_height_);
+}
+
+} // namespace rudnick_rt
@@ -0,0 +1,104 @@
+/**
+ * @file sampler.cpp
+ * @author Ian Rudnick
+ * Implementation of the Owen-scrambled Sobol sampler.
+ */
+#include "sampler.h"
+
+namespace rudnick_rt {
+
+namespace {
+
+// 2^-32, so the largest 32-bit point still maps below 1.
+constexpr double kToUnit = 2.3283064365386963e-10;
+
+/**
+ * Hashes two numbers together into a well-mixed 32-bit seed.
+ */
+uint32_t hashSeed(uint64_t a, uint64_t b) {
+    uint64_t x = a ^ (b * 0x9e3779b97f4a7c15ULL);
+    x ^= x >> 31;
+    x *= 0x7fb5d329728ea185ULL;
+    x ^= x >> 27;
+    x *= 0x81dadef4bc2dd44dULL;
+    x ^= x >> 33;
+    return static_cast<uint32_t>(x);
+}
+
+uint32_t reverseBits(uint32_t x) {
+    x = (x << 16) | (x >> 16);
+    x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+    x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+    x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+    x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+    return x;
+}
+
+/**
+ * Owen-scrambles a 32-bit fixed-point number: every bit gets flipped or
+ * not depending on the bits above it. Works on the bit-reversed number with
+ * a hash where each bit only depends on the lower ones (Laine and Karras),
+ * using Vegdahl's improved constants.
+ */
+uint32_t owenScramble(uint32_t x, uint32_t seed) {
+    x = reverseBits(x);
+    x ^= x * 0x3d20adeau;
+    x += seed;
+    x *= (seed >> 16) | 1;
+    x ^= x * 0x05526c56u;
+    x ^= x * 0x53a22864u;
+    return reverseBits(x);
+}
+
+/**
+ * First Sobol dimension, which is the base-2 van der Corput sequence.
+ */
+uint32_t sobol0(uint32_t index) {
+    return reverseBits(index);
+}
+
+/**
+ * Second Sobol dimension. Its generator matrix is Pascal's triangle mod 2,
+ * so each column is the one before it xor'd with itself shifted down.
+ */
+uint32_t sobol1(uint32_t index) {
+    uint32_t result = 0;
+    for (uint32_t v = 1u << 31; index; index >>= 1, v ^= v >> 1) {
+        if (index & 1)
+            result ^= v;
+    }
+    return result;
+}
+
+} // namespace
+
+
+void SobolSampler::startSample(uint64_t pixel, uint32_t sample,
+                               uint64_t seed) {
+    pixel_seed_ = hashSeed(pixel, seed)
+                | (uint64_t(hashSeed(seed, pixel)) << 32);
+    sample_ = sample;
+    dimension_ = 0;
+}
+
+uint32_t SobolSampler::nextDimensionSeed() {
+    return hashSeed(pixel_seed_, dimension_++);
+}
+
+double SobolSampler::get1D() {
+    uint32_t seed = nextDimensionSeed();
+    // Shuffle which point this sample gets, so this dimension's points
+    // aren't matched up with any other dimension's.
+    uint32_t index = owenScramble(sample_, seed);
+    return owenScramble(sobol0(index), hashSeed(seed, 1)) * kToUnit;
+}
+
+Point2 SobolSampler::get2D() {
+    uint32_t seed = nextDimensionSeed();
+    ++dimension_;
+    uint32_t index = owenScramble(sample_, seed);
+    return Point2{owenScramble(sobol0(index), hashSeed(seed, 1)) * kToUnit,
+                  owenScramble(sobol1(index), hashSeed(seed, 2)) * kToUnit};
+}
+
+} // namespace rudnick_rt
@@ -35,15 +35,36 @@ bool Sphere::hit(
     }
 
     record.t = root;
-    record.point = ray.at(record.t);
-    record.material = material_;
-    Vec3 surface_normal = Vec3::normalize((record.point - center_) / radius_);
-    record.setNormalDirection(ray, surface_normal);
+    record.object = this;
     
     // The ray does hit
     return true;
 }
 
+void Sphere::surfaceDetails(const Ray & ray, hit_record & record) const {
+    record.point = ray.at(record.t);
+    record.material = material_.get();
+    Vec3 surface_normal = Vec3::normalize((record.point - center_) / radius_);
+    record.setNormalDirection(ray, surface_normal);
+}
+
+bool Sphere::occluded(const Ray & ray, double tmin, double tmax) const {
+    Vec3 oc = ray.origin() - center_;
+    auto a = ray.direction().lengthSquared();
+    auto half_b = Vec3::dot(oc, ray.direction());
+    auto c = oc.lengthSquared() - (radius_ * radius_);
+
+    auto discriminant = (half_b * half_b) - (a * c);
+    if (discriminant < 0) return false;
+    auto sqrt_d = std::sqrt(discriminant);
+
+    // Either root within [tmin, tmax] blocks the ray
+    auto root = (-half_b - sqrt_d) / a;
+    if (root >= tmin && root <= tmax) return true;
+    root = (-half_b + sqrt_d) / a;
+    return root >= tmin && root <= tmax;
+}
+
 bool Sphere::boundingBox(AABB& output) const {
     output = AABB(
         this->center_ - Vec3(this->radius_, this->radius_, this->radius_),
@@ -0,0 +1,151 @@
+/**
+ * @file task_pool.cpp
+ * @author Ian Rudnick
+ * Implementation of the work-stealing task pool.
+ */
+#include "task_pool.h"
+
+namespace rudnick_rt {
+
+namespace {
+
+// Which pool the current thread works for, and its queue in that pool.
+thread_local const TaskPool * t_pool = nullptr;
+thread_local size_t t_queue_index = 0;
+
+} // namespace
+
+//-----------------------------------------------------------------------------
+// TaskPool
+
+TaskPool::TaskPool(unsigned num_threads) : queued_(0), stopping_(false) {
+    if (num_threads == 0) {
+        num_threads = std::thread::hardware_concurrency();
+    }
+    if (num_threads == 0) {
+        num_threads = 1;
+    }
+    // Queue 0 belongs to threads outside the pool.
+    for (unsigned i = 0; i < num_threads; ++i) {
+        queues_.emplace_back(new Queue());
+    }
+    for (unsigned i = 1; i < num_threads; ++i) {
+        workers_.emplace_back(&TaskPool::workerLoop, this, i);
+    }
+}
+
+TaskPool::~TaskPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (auto & worker : workers_) {
+        worker.join();
+    }
+}
+
+size_t TaskPool::queueIndex() const {
+    return t_pool == this ? t_queue_index : 0;
+}
+
+void TaskPool::push(Task task) {
+    // Count the task before it's in a queue, so whoever takes it can never
+    // count it off first and wrap the counter around. Count it under the
+    // sleep lock, so a worker can't check for work and go to sleep in
+    // between.
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        ++queued_;
+    }
+    {
+        Queue & queue = *queues_[queueIndex()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    wake_.notify_one();
+    waiting_.notify_one();
+}
+
+bool TaskPool::runOne() {
+    size_t own = queueIndex();
+    Task task;
+    bool found = false;
+
+    // Newest task from our own queue first, while its data is still warm.
+    {
+        Queue & queue = *queues_[own];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            found = true;
+        }
+    }
+    // Otherwise steal the oldest task from someone else.
+    for (size_t i = 1; !found && i < queues_.size(); ++i) {
+        Queue & queue = *queues_[(own + i) % queues_.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            found = true;
+        }
+    }
+    if (!found) return false;
+
+    --queued_;
+    task.work();
+    if (--task.group->pending_ == 0) {
+        // Take the lock so the group's waiter is either still checking, and
+        // sees the 0, or already asleep and gets the notification.
+        { std::lock_guard<std::mutex> lock(sleep_mutex_); }
+        waiting_.notify_all();
+    }
+    return true;
+}
+
+void TaskPool::workerLoop(size_t index) {
+    t_pool = this;
+    t_queue_index = index;
+    while (true) {
+        if (runOne()) continue;
+
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        wake_.wait(lock, [this] { return stopping_ || queued_ > 0; });
+        if (stopping_) return;
+    }
+}
+
+TaskPool & TaskPool::global() {
+    static TaskPool pool;
+    return pool;
+}
+
+//-----------------------------------------------------------------------------
+// TaskGroup
+
+void TaskGroup::run(std::function<void()> work) {
+    // With no workers to hand it to, just do it now.
+    if (pool_.size() == 1) {
+        work();
+        return;
+    }
+    ++pending_;
+    pool_.push(TaskPool::Task{std::move(work), this});
+}
+
+void TaskGroup::wait() {
+    while (pending_ > 0) {
+        if (pool_.runOne()) continue;
+
+        // Nothing to help with, so sleep until the last task finishes or
+        // there's a new task to run.
+        std::unique_lock<std::mutex> lock(pool_.sleep_mutex_);
+        pool_.waiting_.wait(lock, [this] {
+            return pending_ == 0 || pool_.queued_ > 0;
+        });
+    }
+}
+
+} // namespace rudnick_rt
@@ -0,0 +1,96 @@
+/**
+ * @file thread_pool.cpp
+ * @author Ian Rudnick
+ * Implementation of the worker thread pool.
+ */
+#include "thread_pool.h"
+
+namespace rudnick_rt {
+
+ThreadPool::ThreadPool(unsigned num_threads)
+    : body_(nullptr), count_(0), next_index_(0), active_workers_(0),
+      generation_(0), stopping_(false) {
+
+    if (num_threads == 0) {
+        num_threads = std::thread::hardware_concurrency();
+    }
+    // The calling thread counts as one of the threads.
+    for (unsigned i = 1; i < num_threads; ++i) {
+        workers_.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    job_ready_.notify_all();
+    for (auto & worker : workers_) {
+        worker.join();
+    }
+}
+
+void ThreadPool::parallelFor(size_t count,
+                             const std::function<void(size_t)> & body) {
+    if (count == 0) return;
+
+    // No point waking anyone up for a single iteration.
+    if (workers_.empty() || count == 1) {
+        for (size_t i = 0; i < count; ++i) body(i);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        body_ = &body;
+        count_ = count;
+        next_index_ = 0;
+        active_workers_ = static_cast<unsigned>(workers_.size());
+        ++generation_;
+    }
+    job_ready_.notify_all();
+
+    runJob();
+
+    // Wait for the workers to finish their last iterations.
+    std::unique_lock<std::mutex> lock(mutex_);
+    job_done_.wait(lock, [this] { return active_workers_ == 0; });
+    body_ = nullptr;
+}
+
+void ThreadPool::workerLoop() {
+    unsigned long seen_generation = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            job_ready_.wait(lock, [this, seen_generation] {
+                return stopping_ || generation_ != seen_generation;
+            });
+            if (stopping_) return;
+            seen_generation = generation_;
+        }
+
+        runJob();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--active_workers_ == 0) {
+            job_done_.notify_one();
+        }
+    }
+}
+
+void ThreadPool::runJob() {
+    while (true) {
+        size_t i = next_index_.fetch_add(1);
+        if (i >= count_) break;
+        (*body_)(i);
+    }
+}
+
+ThreadPool & ThreadPool::global() {
+    static ThreadPool pool;
+    return pool;
+}
+
+} // namespace rudnick_rt
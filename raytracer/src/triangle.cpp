@@ -41,22 +41,61 @@ bool Triangle::hit(const Ray& ray, double tmin, double tmax,
 	}
 	auto t = f * Vec3::dot(e2, r);
 	// check if t is outside the range [tmin, tmax]
-	if (t < epsilon) {
+	if (t < tmin || t < epsilon || t > tmax) {
 		return false;
 	}
 
-	// Record the uv coordinates of the hit, and the dist along the ray
-	//record.u = u;
-	//record.v = v;
+	// Record the barycentric coordinates of the hit, and the dist along the
+	// ray
+	record.u = u;
+	record.v = v;
 	record.t = t;
+	record.object = this;
 
+	return true;
+}
+
+
+void Triangle::surfaceDetails(const Ray& ray, hit_record& record) const
+{
 	// Compute the normal vector at the hit point with barycentric interpolation
-	Vec3 interpolated_normal = n0_*(1-u-v) + n1_*u + n2_*v;
+	auto u = record.u;
+	auto v = record.v;
+	// Blending unit normals shortens them, and shading needs unit length.
+	Vec3 interpolated_normal = Vec3::normalize(
+		n0_*(1-u-v) + n1_*u + n2_*v);
 	record.setNormalDirection(ray, interpolated_normal);
-	record.material = this->m_;
-	record.point = ray.at(t);
+	record.material = this->m_.get();
+	record.point = ray.at(record.t);
+}
 
-	return true;
+
+bool Triangle::occluded(const Ray& ray, double tmin, double tmax) const
+{
+	auto epsilon = 0.00001;
+
+	// Same test as hit(), without filling in a record
+	auto e1 = this->v1_ - this->v0_;
+	auto e2 = this->v2_ - this->v0_;
+	auto q = Vec3::cross(ray.direction(), e2);
+	auto a = Vec3::dot(e1, q);
+	if (a > -epsilon && a < epsilon) {
+		return false;
+	}
+
+	auto f = 1.0 / a;
+	auto s = ray.origin() - v0_;
+	auto u = f * Vec3::dot(s, q);
+	if (u < 0.0 || u > 1.0) {
+		return false;
+	}
+	auto r = Vec3::cross(s, e1);
+	auto v = f * Vec3::dot(ray.direction(), r);
+	if (v < 0.0 || (u+v) > 1.0) {
+		return false;
+	}
+	auto t = f * Vec3::dot(e2, r);
+	return t >= tmin && t >= epsilon && t <= tmax;
 }
 
 
@@ -5,11 +5,22 @@
  */
 #include "triangle_mesh.h"
 
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <utility>
 #include <vector>
 
-#include "hittable_list.h"
+#include "linear_bvh.h"
+#include "rrt_enum.h"
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "tiny_obj_loader.h"
@@ -17,8 +28,260 @@
 
 namespace rudnick_rt {
 
+namespace {
+
+// Leaves hold up to two blocks' worth of triangles.
+const size_t kMaxLeafSize = 8;
+const uint32_t kBlockSize = 4;
+
+// Change this whenever the file layout or the way meshes are built changes,
+// so old files are rejected and old caches get rebuilt.
+const uint32_t kFileVersion = 2;
+const char kFileMagic[8] = {'R', 'R', 'T', 'M', 'E', 'S', 'H', '\0'};
+const char * const kCacheExtension = ".bvhcache";
+const char * const kBinaryExtension = ".rmesh";
+
+// Flags for a binary mesh file.
+const uint32_t kHasBVH = 1;
+
+// Sections of a binary mesh file start on this alignment, so the buffers
+// can be used straight out of the mapped file.
+const size_t kFileAlignment = 16;
+
+/**
+ * Start of a binary mesh file. The sections follow in this order:
+ * positions, normals, indices, and if there's a BVH, blocks and nodes.
+ * Numbers are stored in the machine's own byte order.
+ */
+struct MeshHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t flags;
+	uint64_t key;
+	uint64_t num_vertices;
+	uint64_t num_triangles;
+	uint64_t num_slots;
+	uint64_t num_nodes;
+	double bounds[6];
+};
+
+// Where each section of a binary mesh file starts.
+struct MeshLayout {
+	size_t positions;
+	size_t normals;
+	size_t indices;
+	size_t blocks;
+	size_t nodes;
+	size_t end;
+};
+
+size_t alignUp(size_t offset)
+{
+	return (offset + kFileAlignment - 1) / kFileAlignment * kFileAlignment;
+}
+
+MeshLayout meshLayout(const MeshHeader& header)
+{
+	bool has_bvh = header.flags & kHasBVH;
+	MeshLayout layout;
+	layout.positions = alignUp(sizeof(MeshHeader));
+	layout.normals = alignUp(layout.positions
+							 + 3 * header.num_vertices * sizeof(float));
+	layout.indices = alignUp(layout.normals
+							 + header.num_vertices * sizeof(uint32_t));
+	layout.blocks = alignUp(layout.indices
+							+ 3 * header.num_slots * sizeof(uint32_t));
+	layout.nodes = alignUp(layout.blocks + (has_bvh ?
+		header.num_slots / kBlockSize * sizeof(TriangleBlock) : 0));
+	layout.end = layout.nodes
+		+ (has_bvh ? header.num_nodes * sizeof(WideBVHNode) : 0);
+	return layout;
+}
+
+bool endsWith(const std::string& s, const std::string& suffix)
+{
+	return s.size() >= suffix.size() &&
+		s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+/**
+ * Adds bytes to a 64-bit FNV-1a hash.
+ */
+uint64_t hashBytes(const void * data, size_t size, uint64_t hash)
+{
+	const unsigned char * bytes = static_cast<const unsigned char *>(data);
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+/**
+ * Hashes an OBJ file along with everything that affects how it's built.
+ * @param filename Name of the .obj file.
+ * @param key Output for the hash.
+ * @return False if the file couldn't be read.
+ */
+bool cacheKey(const std::string& filename, uint64_t& key)
+{
+	MappedFile file(filename);
+	if (!file.valid()) return false;
+
+	uint64_t settings[] = {
+		kFileVersion,
+		static_cast<uint64_t>(BVHSplitMethod::SAH),
+		kMaxLeafSize,
+		kBlockSize,
+		sizeof(TriangleBlock),
+		sizeof(WideBVHNode)
+	};
+	key = hashBytes(settings, sizeof(settings), 14695981039346656037ull);
+	key = hashBytes(file.data(), file.size(), key);
+	return true;
+}
+
+/**
+ * Rounds a distance to the nearest float at or above it, so the triangle
+ * blocks never accept a hit nearer than tmin.
+ */
+float floatAtLeast(double x)
+{
+	if (x >= FLT_MAX) return FLT_MAX;
+	float f = static_cast<float>(x);
+	return f < x ? std::nextafter(f, FLT_MAX) : f;
+}
+
+/**
+ * Rounds a distance to the nearest float at or below it, so the triangle
+ * blocks never accept a hit farther than tmax.
+ */
+float floatAtMost(double x)
+{
+	if (x >= FLT_MAX) return FLT_MAX;
+	float f = static_cast<float>(x);
+	return f > x ? std::nextafter(f, -FLT_MAX) : f;
+}
+
+/**
+ * Checks every offset in a binary mesh file against the sizes in its
+ * header, so a damaged file can't send a ray outside the mapping or past
+ * the end of the traversal stack. Reads each index and node once.
+ * @return False if any vertex index, child node or leaf range is out of
+ *         bounds, or the nodes don't form a tree no deeper than
+ *         WideBVH::kMaxDepth.
+ */
+bool validMesh(const MeshHeader& header, const char * data,
+			   const MeshLayout& layout)
+{
+	auto indices = reinterpret_cast<const uint32_t *>(data + layout.indices);
+	for (uint64_t i = 0; i < 3 * header.num_slots; ++i) {
+		if (indices[i] >= header.num_vertices) return false;
+	}
+	if (!(header.flags & kHasBVH)) return true;
+
+	if (header.num_triangles > header.num_slots) return false;
+	if (header.num_nodes == 0) return true;
+
+	// Walk the tree from the root. Every node must be reached exactly
+	// once, so there are no cycles or shared subtrees, and no deeper than
+	// traversal can handle. Empty slots are the only children allowed to
+	// point back at the root.
+	auto nodes = reinterpret_cast<const WideBVHNode *>(data + layout.nodes);
+	std::vector<bool> reached(header.num_nodes, false);
+	std::vector<std::pair<uint32_t, int>> stack(1, std::make_pair(0u, 1));
+	reached[0] = true;
+	while (!stack.empty()) {
+		uint32_t n = stack.back().first;
+		int depth = stack.back().second;
+		stack.pop_back();
+		const WideBVHNode& node = nodes[n];
+		for (int c = 0; c < 4; ++c) {
+			if (node.isEmpty(c)) continue;
+			uint64_t child = node.child[c];
+			uint64_t count = node.num_primitives[c];
+			if (count > 0) {
+				if (child + count > header.num_slots) return false;
+				continue;
+			}
+			if (child >= header.num_nodes || reached[child] ||
+				depth >= WideBVH::kMaxDepth) {
+				return false;
+			}
+			reached[child] = true;
+			stack.push_back(std::make_pair(uint32_t(child), depth + 1));
+		}
+	}
+	return true;
+}
+
+/**
+ * Writes zeros until a stream reaches a section's offset.
+ */
+void padTo(std::ofstream& out, size_t offset)
+{
+	static const char zeros[kFileAlignment] = {};
+	size_t position = static_cast<size_t>(out.tellp());
+	out.write(zeros, offset - position);
+}
+
+/**
+ * Writes a buffer to a stream, starting at a section's offset.
+ */
+template <typename T>
+void writeSection(std::ofstream& out, size_t offset, const T * data,
+				  size_t count)
+{
+	padTo(out, offset);
+	out.write(reinterpret_cast<const char *>(data), count * sizeof(T));
+}
+
+} // namespace
+
+
 TriangleMesh::TriangleMesh(const std::string& filename,
-						   std::shared_ptr<Material> mat)
+						   std::shared_ptr<Material> mat, bool use_cache)
+	: material_(mat)
+{
+	if (endsWith(filename, kBinaryExtension)) {
+		if (!loadBinary(filename, nullptr)) {
+			std::cerr << "WARNING: Could not load binary mesh " << filename
+					  << std::endl;
+		}
+		return;
+	}
+
+	std::string cache_path = filename + kCacheExtension;
+	bool has_key = use_cache && cacheKey(filename, key_);
+	if (has_key && loadBinary(cache_path, &key_)) {
+		return;
+	}
+
+	if (loadObj(filename) && has_key && !save(cache_path)) {
+		std::cerr << "WARNING: Could not write mesh cache " << cache_path
+				  << std::endl;
+	}
+}
+
+
+std::shared_ptr<const TriangleMesh> TriangleMesh::load(const std::string& filename)
+{
+	// Meshes are only kept alive by their instances, so a mesh nothing uses
+	// anymore is freed and will be loaded again next time.
+	static std::mutex cache_mutex;
+	static std::map<std::string, std::weak_ptr<const TriangleMesh>> cache;
+
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	auto mesh = cache[filename].lock();
+	if (!mesh) {
+		mesh = std::make_shared<TriangleMesh>(filename, nullptr);
+		cache[filename] = mesh;
+	}
+	return mesh;
+}
+
+
+bool TriangleMesh::loadObj(const std::string& filename)
 {
 	// load mesh into vector of vertices
 	tinyobj::attrib_t attrib;
@@ -32,91 +295,297 @@ TriangleMesh::TriangleMesh(const std::string& filename,
 	if (!err.empty()) {
 		std::cerr << err << std::endl;
 	}
-	if (load_successful) {
-		size_t num_vertices = attrib.vertices.size() / 3;
+	if (!load_successful) {
+		std::cerr << "WARNING: Could not load OBJ file " << filename << std::endl;
+		return false;
+	}
 
-		// Create a vector of the vertex positions.
-		std::vector<Point3> positions;
-		for (size_t i = 0; i < num_vertices; ++i) {
-			positions.push_back(Point3(attrib.vertices[i*3+0],
-									   attrib.vertices[i*3+1],
-									   attrib.vertices[i*3+2]));
-		}
+	// The loader already stores positions as packed xyz floats.
+	position_storage_ = std::move(attrib.vertices);
+	positions_ = position_storage_.data();
+	num_vertices_ = position_storage_.size() / 3;
 
-		// Create a vector for the vertex indices
-		std::vector<int> indices;
-		// For every shape, for every face, push the vertex indices to the buffer
-		for (size_t s = 0; s < shapes.size(); s++) {
-			for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) {
+	// For every shape, for every face, push the vertex indices to the buffer
+	std::vector<uint32_t> indices;
+	for (size_t s = 0; s < shapes.size(); s++) {
+		for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) {
 
-				for (size_t v = 0; v < 3; v++) {
-					tinyobj::index_t idx = shapes[s].mesh.indices[3 * f + v];
-					indices.push_back(idx.vertex_index);
-				}
+			for (size_t v = 0; v < 3; v++) {
+				tinyobj::index_t idx = shapes[s].mesh.indices[3 * f + v];
+				indices.push_back(static_cast<uint32_t>(idx.vertex_index));
 			}
 		}
-		size_t num_triangles = indices.size() / 3;
-
-		// Create a vector for the vertex normals.
-		std::vector<Vec3> normals;
-		normals.resize(num_vertices);
-
-		// Loop over each face.
-		for (size_t i = 0; i < num_triangles; ++i) {
-			// Compute the normal as the cross product of the three vertices.
-			auto e1 = positions[indices[i*3+1]] - positions[indices[i*3+0]];
-			auto e2 = positions[indices[i*3+2]] - positions[indices[i*3+0]];
-			Vec3 e1_cross_e2 = Vec3::cross(e1, e2);
-			Vec3 face_normal = Vec3::normalize(e1_cross_e2);
-
-			// Scale the normal by the triangle's surface area.
-			face_normal *= e1_cross_e2.length()/2;
-
-			// Add the face normal to the normals of the three vertices.
-			normals[indices[i*3+0]] += face_normal;
-			normals[indices[i*3+1]] += face_normal;
-			normals[indices[i*3+2]] += face_normal;
+	}
+	size_t num_triangles = indices.size() / 3;
+
+	// Create a vector for the vertex normals.
+	std::vector<Vec3> normals(num_vertices_);
+
+	// Loop over each face.
+	for (size_t i = 0; i < num_triangles; ++i) {
+		// Compute the normal as the cross product of the three vertices.
+		auto p0 = position(indices[i*3+0]);
+		auto e1 = position(indices[i*3+1]) - p0;
+		auto e2 = position(indices[i*3+2]) - p0;
+		Vec3 e1_cross_e2 = Vec3::cross(e1, e2);
+
+		// Scale the normal by the triangle's surface area. The cross product
+		// is already twice the area times the unit normal.
+		Vec3 face_normal = e1_cross_e2 / 2;
+
+		// Add the face normal to the normals of the three vertices.
+		normals[indices[i*3+0]] += face_normal;
+		normals[indices[i*3+1]] += face_normal;
+		normals[indices[i*3+2]] += face_normal;
+	}
+
+	// Normalize each vertex normal and pack it into the normal buffer.
+	// Vertices no face uses get an arbitrary normal.
+	normal_storage_.resize(num_vertices_);
+	for (size_t i = 0; i < num_vertices_; ++i) {
+		Vec3 n = normals[i].lengthSquared() > 0 ? normals[i] : Vec3(0, 0, 1);
+		normal_storage_[i] = encodeOctahedral(Vec3::normalize(n));
+	}
+	normals_ = normal_storage_.data();
+
+	buildBVH(indices);
+	return true;
+}
+
+
+void TriangleMesh::buildBVH(const std::vector<uint32_t>& indices)
+{
+	size_t num_triangles = indices.size() / 3;
+
+	// Build the BVH over the triangles' bounding boxes.
+	std::vector<AABB> boxes(num_triangles);
+	for (size_t i = 0; i < num_triangles; ++i) {
+		Point3 v0 = position(indices[i*3+0]);
+		Point3 v1 = position(indices[i*3+1]);
+		Point3 v2 = position(indices[i*3+2]);
+		Point3 min, max;
+		for (int a = 0; a < 3; ++a) {
+			min[a] = std::min(v0[a], std::min(v1[a], v2[a]));
+			max[a] = std::max(v0[a], std::max(v1[a], v2[a]));
+		}
+		boxes[i] = AABB(min, max);
+	}
+
+	// Leaves start on a block boundary so they can be tested a whole block
+	// at a time.
+	std::vector<uint32_t> order;
+	LinearBVH binary_bvh;
+	binary_bvh.build(boxes, BVHSplitMethod::SAH, kMaxLeafSize, order);
+	binary_bvh.alignLeaves(kBlockSize, order);
+	bvh_.build(binary_bvh);
+
+	// Store the triangles in leaf order, so each leaf is a contiguous range.
+	// Padding slots are left as zeroed lanes, which nothing can hit.
+	index_storage_.assign(3 * order.size(), 0);
+	block_storage_.assign(order.size() / kBlockSize, TriangleBlock());
+	for (size_t i = 0; i < order.size(); ++i) {
+		if (order[i] == LinearBVH::kEmptySlot) continue;
+		for (size_t v = 0; v < 3; ++v) {
+			index_storage_[i*3 + v] = indices[order[i]*3 + v];
 		}
+		block_storage_[i / kBlockSize].set(i % kBlockSize,
+										   position(index_storage_[i*3 + 0]),
+										   position(index_storage_[i*3 + 1]),
+										   position(index_storage_[i*3 + 2]));
+	}
+	indices_ = index_storage_.data();
+	blocks_ = block_storage_.data();
+	num_triangles_ = num_triangles;
+	num_slots_ = order.size();
+}
+
+
+bool TriangleMesh::loadBinary(const std::string& path, const uint64_t * key)
+{
+	std::unique_ptr<MappedFile> file(new MappedFile(path));
+	if (!file->valid() || file->size() < sizeof(MeshHeader)) return false;
+
+	MeshHeader header;
+	std::memcpy(&header, file->data(), sizeof(header));
+	if (std::memcmp(header.magic, kFileMagic, sizeof(kFileMagic)) != 0 ||
+		header.version != kFileVersion || (key && header.key != *key)) {
+		return false;
+	}
+	// Make sure the counts can't overflow the layout before trusting it.
+	uint64_t counts[] = {header.num_vertices, header.num_slots,
+						 header.num_nodes};
+	for (uint64_t count : counts) {
+		if (count > file->size()) return false;
+	}
+	bool has_bvh = header.flags & kHasBVH;
+	if (has_bvh && header.num_slots % kBlockSize != 0) return false;
+	MeshLayout layout = meshLayout(header);
+	if (layout.end > file->size()) return false;
+
+	const char * data = file->data();
+	if (!validMesh(header, data, layout)) return false;
+	positions_ = reinterpret_cast<const float *>(data + layout.positions);
+	normals_ = reinterpret_cast<const uint32_t *>(data + layout.normals);
+	num_vertices_ = header.num_vertices;
+	key_ = header.key;
+	file_ = std::move(file);
 
-		// Loop over each vertex normal and normalize them.
-		for (size_t i = 0; i < num_vertices; ++i) {
-			normals[i] = Vec3::normalize(normals[i]);
+	auto indices = reinterpret_cast<const uint32_t *>(data + layout.indices);
+	if (!has_bvh) {
+		buildBVH(std::vector<uint32_t>(indices,
+									   indices + 3 * header.num_slots));
+		return true;
+	}
+
+	indices_ = indices;
+	blocks_ = reinterpret_cast<const TriangleBlock *>(data + layout.blocks);
+	num_triangles_ = header.num_triangles;
+	num_slots_ = header.num_slots;
+	AABB bounds(Point3(header.bounds[0], header.bounds[1], header.bounds[2]),
+				Point3(header.bounds[3], header.bounds[4], header.bounds[5]));
+	bvh_.view(reinterpret_cast<const WideBVHNode *>(data + layout.nodes),
+			  header.num_nodes, bounds);
+	return true;
+}
+
+
+bool TriangleMesh::save(const std::string& path, bool include_bvh) const
+{
+	// Without the BVH, the padding between leaves isn't needed. Padding
+	// slots are the only triangles with all three corners on one vertex.
+	std::vector<uint32_t> unpadded;
+	if (!include_bvh) {
+		for (size_t i = 0; i < num_slots_; ++i) {
+			const uint32_t * tri = indices_ + 3*i;
+			if (tri[0] == tri[1] && tri[1] == tri[2]) continue;
+			unpadded.insert(unpadded.end(), tri, tri + 3);
 		}
+	}
 
-		// Create the triangle primitives and add them to the HittableList.
-		HittableList triangles;
-		for (size_t i = 0; i < num_triangles; ++i) {
-			int idx0 = indices[i*3+0];
-			int idx1 = indices[i*3+1];
-			int idx2 = indices[i*3+2];
-			triangles.add(std::make_shared<Triangle>(positions[idx0],
-													 positions[idx1],
-													 positions[idx2],
-													 normals[idx0],
-													 normals[idx1],
-													 normals[idx2],
-													 mat));
+	MeshHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, kFileMagic, sizeof(kFileMagic));
+	header.version = kFileVersion;
+	header.flags = include_bvh ? kHasBVH : 0;
+	header.key = key_;
+	header.num_vertices = num_vertices_;
+	header.num_triangles = include_bvh ? num_triangles_ : unpadded.size() / 3;
+	header.num_slots = include_bvh ? num_slots_ : unpadded.size() / 3;
+	header.num_nodes = include_bvh ? bvh_.numNodes() : 0;
+	AABB bounds;
+	if (bvh_.boundingBox(bounds)) {
+		for (int a = 0; a < 3; ++a) {
+			header.bounds[a] = bounds.min()[a];
+			header.bounds[3 + a] = bounds.max()[a];
 		}
+	}
+	MeshLayout layout = meshLayout(header);
 
-		this->mesh_ = std::make_shared<BVHTree>(triangles);
-		
+	// Write to a temporary file and move it into place, so another run
+	// never sees half a file.
+	std::string temp_path = path + ".tmp";
+	{
+		std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+		if (!out) return false;
+		out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+		writeSection(out, layout.positions, positions_, 3 * num_vertices_);
+		writeSection(out, layout.normals, normals_, num_vertices_);
+		if (include_bvh) {
+			writeSection(out, layout.indices, indices_, 3 * num_slots_);
+			writeSection(out, layout.blocks, blocks_,
+						 num_slots_ / kBlockSize);
+			writeSection(out, layout.nodes, bvh_.nodes(), bvh_.numNodes());
+		}
+		else {
+			writeSection(out, layout.indices, unpadded.data(),
+						 unpadded.size());
+		}
+		if (!out) {
+			out.close();
+			std::remove(temp_path.c_str());
+			return false;
+		}
 	}
-	else {
-		std::cerr << "WARNING: Could not load OBJ file " << filename << std::endl;
+#ifdef WIN32
+	// Windows won't rename over an existing file.
+	std::remove(path.c_str());
+#endif
+	if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+		std::remove(temp_path.c_str());
+		return false;
 	}
+	return true;
+}
+
+
+void TriangleMesh::surfaceDetails(const Ray & ray, hit_record & record) const
+{
+	uint32_t triangle = record.primitive;
+	uint32_t i0 = indices_[triangle*3 + 0];
+	uint32_t i1 = indices_[triangle*3 + 1];
+	uint32_t i2 = indices_[triangle*3 + 2];
+
+	// Compute the normal vector at the hit point with barycentric interpolation
+	auto u = record.u;
+	auto v = record.v;
+	// Blending unit normals shortens them, and shading needs unit length.
+	Vec3 interpolated_normal = Vec3::normalize(
+		normal(i0)*(1-u-v) + normal(i1)*u + normal(i2)*v);
+	record.setNormalDirection(ray, interpolated_normal);
+	record.material = material_.get();
+	record.point = ray.at(record.t);
 }
 
 
 bool TriangleMesh::hit(
 	const Ray & ray, double tmin, double tmax, hit_record & record) const
 {
-	return mesh_->hit(ray, tmin, tmax, record);
+	float tmin_f = floatAtLeast(tmin);
+	return bvh_.traverse(ray, tmin, tmax,
+		[&](uint32_t first, uint32_t count, double & closest) {
+			bool hit_anything = false;
+			uint32_t end = (first + count + 3) / 4;
+			for (uint32_t b = first / 4; b < end; ++b) {
+				float tmax_f = floatAtMost(closest);
+				float t, u, v;
+				int lane = blocks_[b].hit(ray, tmin_f, tmax_f, t, u, v);
+				if (lane >= 0) {
+					hit_anything = true;
+					closest = t;
+					// Only note which triangle it was. The normal and
+					// point wait until the closest hit is known.
+					record.t = t;
+					record.u = u;
+					record.v = v;
+					record.object = this;
+					record.primitive = 4*b + lane;
+				}
+			}
+			return hit_anything;
+		});
+}
+
+
+bool TriangleMesh::occluded(const Ray & ray, double tmin, double tmax) const
+{
+	float tmin_f = floatAtLeast(tmin);
+	float tmax_f = floatAtMost(tmax);
+	return bvh_.occluded(ray, tmin, tmax,
+		[&](uint32_t first, uint32_t count) {
+			uint32_t end = (first + count + 3) / 4;
+			for (uint32_t b = first / 4; b < end; ++b) {
+				if (blocks_[b].occluded(ray, tmin_f, tmax_f)) {
+					return true;
+				}
+			}
+			return false;
+		});
 }
 
 
 bool TriangleMesh::boundingBox(AABB& output) const
 {
-	return mesh_->boundingBox(output);
+	return bvh_.boundingBox(output);
 }
 
 }
@@ -0,0 +1,134 @@
+/**
+ * @file wide_bvh.cpp
+ * @author Ian Rudnick
+ * Collapses a binary BVH into a 4-wide BVH.
+ */
+#include "wide_bvh.h"
+
+namespace rudnick_rt {
+
+namespace {
+
+/**
+ * Gets the surface area of a binary node's box.
+ */
+float nodeArea(const LinearBVHNode & node) {
+    float dx = node.max[0] - node.min[0];
+    float dy = node.max[1] - node.min[1];
+    float dz = node.max[2] - node.min[2];
+    return dx*dy + dy*dz + dz*dx;
+}
+
+} // namespace
+
+
+WideBVH::WideBVH(const WideBVH & other)
+    : nodes_(other.nodes_),
+      root_(other.nodes_.empty() ? other.root_ : nodes_.data()),
+      num_nodes_(other.num_nodes_),
+      bounds_(other.bounds_) {}
+
+WideBVH & WideBVH::operator=(const WideBVH & other) {
+    if (this != &other) {
+        nodes_ = other.nodes_;
+        root_ = other.nodes_.empty() ? other.root_ : nodes_.data();
+        num_nodes_ = other.num_nodes_;
+        bounds_ = other.bounds_;
+    }
+    return *this;
+}
+
+void WideBVH::build(const LinearBVH & bvh) {
+    nodes_.clear();
+    root_ = nullptr;
+    num_nodes_ = 0;
+    if (!bvh.boundingBox(bounds_)) return;
+
+    const auto & binary = bvh.nodes();
+    nodes_.reserve(binary.size() / 2 + 1);
+    collapse(binary, 0);
+    root_ = nodes_.data();
+    num_nodes_ = nodes_.size();
+}
+
+void WideBVH::view(const WideBVHNode * nodes, size_t count,
+                   const AABB & bounds) {
+    nodes_.clear();
+    root_ = nodes;
+    num_nodes_ = count;
+    bounds_ = bounds;
+}
+
+uint32_t WideBVH::collapse(const std::vector<LinearBVHNode> & binary,
+                           uint32_t index) {
+    // Gather up to four children by repeatedly opening up the biggest
+    // interior node, which is the one most likely to be hit.
+    uint32_t slots[4];
+    int num_slots = 0;
+    if (binary[index].num_primitives > 0) {
+        // A leaf at the root becomes a node with a single leaf child.
+        slots[num_slots++] = index;
+    }
+    else {
+        slots[num_slots++] = index + 1;
+        slots[num_slots++] = binary[index].second_child_offset;
+    }
+    while (num_slots < 4) {
+        int best = -1;
+        float best_area = -1;
+        for (int i = 0; i < num_slots; ++i) {
+            const auto & node = binary[slots[i]];
+            if (node.num_primitives == 0 && nodeArea(node) > best_area) {
+                best = i;
+                best_area = nodeArea(node);
+            }
+        }
+        if (best < 0) break;
+
+        uint32_t opened = slots[best];
+        slots[best] = opened + 1;
+        slots[num_slots++] = binary[opened].second_child_offset;
+    }
+
+    uint32_t wide_index = static_cast<uint32_t>(nodes_.size());
+    nodes_.push_back(WideBVHNode());
+
+    for (int c = 0; c < 4; ++c) {
+        // Empty slots get an inside-out box that no ray can hit.
+        if (c >= num_slots) {
+            for (int i = 0; i < 3; ++i) {
+                nodes_[wide_index].bounds[0][i][c] = FLT_MAX;
+                nodes_[wide_index].bounds[1][i][c] = -FLT_MAX;
+            }
+            nodes_[wide_index].child[c] = 0;
+            nodes_[wide_index].num_primitives[c] = 0;
+            continue;
+        }
+
+        const auto & node = binary[slots[c]];
+        for (int i = 0; i < 3; ++i) {
+            nodes_[wide_index].bounds[0][i][c] = node.min[i];
+            nodes_[wide_index].bounds[1][i][c] = node.max[i];
+        }
+
+        if (node.num_primitives > 0) {
+            nodes_[wide_index].child[c] = node.primitives_offset;
+            nodes_[wide_index].num_primitives[c] = node.num_primitives;
+        }
+        else {
+            // Collapsing the child can grow nodes_, so index it fresh after.
+            uint32_t child_index = collapse(binary, slots[c]);
+            nodes_[wide_index].child[c] = child_index;
+            nodes_[wide_index].num_primitives[c] = 0;
+        }
+    }
+    return wide_index;
+}
+
+bool WideBVH::boundingBox(AABB & box) const {
+    if (num_nodes_ == 0) return false;
+    box = bounds_;
+    return true;
+}
+
+} // namespace rudnick_rt
@@ -0,0 +1,362 @@
+/**
+ * @file bvh_crosscheck.cpp
+ * @author Ian Rudnick
+ * Randomized test of the BVHs against brute force.
+ * Fires random rays, with random [tmin, tmax] windows, at scenes of spheres,
+ * rectangles, boxes, a triangle mesh, and instances, and checks that a
+ * BVHTree over each scene, built every way, finds the same hit as testing
+ * every object in a HittableList: whether there is one, how far away it is,
+ * and what was hit. occluded() has to agree with hit() too.
+ *
+ * Usage: bvh_crosscheck [rays per scene] [seed]
+ * Run it from the raytracer directory, so it can find the cow. Exits with 1
+ * if any ray disagrees.
+ */
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "aa_rectangle.h"
+#include "bvh_tree.h"
+#include "hittable_list.h"
+#include "instance.h"
+#include "material.h"
+#include "matrix34.h"
+#include "rng.h"
+#include "sphere.h"
+#include "tiny_obj_loader.h"
+#include "triangle.h"
+#include "triangle_mesh.h"
+
+using namespace rudnick_rt;
+
+namespace {
+
+const char * const kMeshFile = "data/objects/cow.obj";
+
+/**
+ * One scene, as a list to test by brute force, and the objects the BVH side
+ * should report for what the list reports.
+ */
+struct Scene {
+    std::string name;
+    HittableList list;
+    // Objects the BVH side reports as something else, such as the mesh for
+    // each of its triangles. Anything not in here should come back as
+    // itself.
+    std::map<const Hittable *, const Hittable *> bvh_object;
+    // How far apart the two distances can be, relative to the distance.
+    // The mesh is tested in single precision, and its triangles in double.
+    double tolerance = 0;
+};
+
+RNG rng(1, 1);
+
+double uniform(double min, double max) {
+    return min + (max - min) * rng.nextDouble();
+}
+
+Point3 randomPoint(double min, double max) {
+    return Point3(uniform(min, max), uniform(min, max), uniform(min, max));
+}
+
+Matrix34 randomMatrix(double spread) {
+    Vec3 axis(uniform(-1, 1), uniform(-1, 1), uniform(-1, 1) + 1e-3);
+    double scale = uniform(0.5, 2);
+    return Matrix34::translation(randomPoint(-spread, spread))
+         * Matrix34::rotation(axis, uniform(0, 360))
+         * Matrix34::scaling(Vec3(scale, scale * uniform(0.5, 2), scale));
+}
+
+/**
+ * Makes a box out of six rectangles, the way the scenes do.
+ */
+std::shared_ptr<HittableList> makeBox(const Point3 & min, const Point3 & max,
+                                      std::shared_ptr<Material> mat) {
+    auto box = std::make_shared<HittableList>();
+    box->add(std::make_shared<XYRect>(min.x(), max.x(), min.y(), max.y(),
+                                      min.z(), mat));
+    box->add(std::make_shared<XYRect>(min.x(), max.x(), min.y(), max.y(),
+                                      max.z(), mat));
+    box->add(std::make_shared<XZRect>(min.x(), max.x(), min.z(), max.z(),
+                                      min.y(), mat));
+    box->add(std::make_shared<XZRect>(min.x(), max.x(), min.z(), max.z(),
+                                      max.y(), mat));
+    box->add(std::make_shared<YZRect>(min.y(), max.y(), min.z(), max.z(),
+                                      min.x(), mat));
+    box->add(std::make_shared<YZRect>(min.y(), max.y(), min.z(), max.z(),
+                                      max.x(), mat));
+    return box;
+}
+
+/**
+ * Loads the mesh's triangles as separate Triangle objects.
+ */
+std::shared_ptr<HittableList> loadTriangles(const std::string & filename,
+                                            std::shared_ptr<Material> mat) {
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string err;
+    tinyobj::LoadObj(&attrib, &shapes, &materials, &err, filename.c_str(),
+                     0);
+
+    auto triangles = std::make_shared<HittableList>();
+    auto vertex = [&attrib](const tinyobj::index_t & index) {
+        const float * p = &attrib.vertices[3 * index.vertex_index];
+        return Point3(p[0], p[1], p[2]);
+    };
+    for (const tinyobj::shape_t & shape : shapes) {
+        const std::vector<tinyobj::index_t> & indices = shape.mesh.indices;
+        for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+            triangles->add(std::make_shared<Triangle>(
+                vertex(indices[i]), vertex(indices[i + 1]),
+                vertex(indices[i + 2]), mat));
+        }
+    }
+    return triangles;
+}
+
+Scene primitiveScene(std::shared_ptr<Material> mat) {
+    Scene scene;
+    scene.name = "spheres, rectangles and boxes";
+    for (int i = 0; i < 200; ++i) {
+        scene.list.add(std::make_shared<Sphere>(randomPoint(-10, 10),
+                                                uniform(0.1, 1.5), mat));
+    }
+    for (int i = 0; i < 60; ++i) {
+        Point3 a = randomPoint(-10, 10);
+        Point3 b = a + Vec3(uniform(0.1, 4), uniform(0.1, 4), uniform(0.1, 4));
+        double k = uniform(-10, 10);
+        switch (i % 3) {
+        case 0:
+            scene.list.add(std::make_shared<XYRect>(a.x(), b.x(), a.y(),
+                                                    b.y(), k, mat));
+            break;
+        case 1:
+            scene.list.add(std::make_shared<XZRect>(a.x(), b.x(), a.z(),
+                                                    b.z(), k, mat));
+            break;
+        default:
+            scene.list.add(std::make_shared<YZRect>(a.y(), b.y(), a.z(),
+                                                    b.z(), k, mat));
+            break;
+        }
+    }
+    for (int i = 0; i < 40; ++i) {
+        Point3 min = randomPoint(-10, 10);
+        Point3 max = min + Vec3(uniform(0.1, 3), uniform(0.1, 3),
+                                uniform(0.1, 3));
+        scene.list.add(makeBox(min, max, mat));
+    }
+    return scene;
+}
+
+Scene meshScene(std::shared_ptr<Material> mat) {
+    Scene scene;
+    scene.name = "triangle mesh";
+    scene.tolerance = 1e-4;
+    auto mesh = std::make_shared<TriangleMesh>(kMeshFile, mat, false);
+    auto triangles = loadTriangles(kMeshFile, mat);
+    for (const auto & triangle : triangles->objects_) {
+        scene.bvh_object[triangle.get()] = mesh.get();
+    }
+    // The BVH side tests the mesh itself, and the list each triangle.
+    scene.list.add(triangles);
+    scene.list.add(std::make_shared<Sphere>(Point3(0, 0, 0), 0.5, mat));
+    scene.bvh_object[triangles.get()] = mesh.get();
+    scene.list.add(mesh);
+    return scene;
+}
+
+Scene instanceScene(std::shared_ptr<Material> mat) {
+    Scene scene;
+    scene.name = "mesh instances and transforms";
+    scene.tolerance = 1e-4;
+    std::shared_ptr<const TriangleMesh> mesh =
+        std::make_shared<TriangleMesh>(kMeshFile, nullptr, false);
+    auto triangles = loadTriangles(kMeshFile, mat);
+    for (int i = 0; i < 6; ++i) {
+        Matrix34 matrix = randomMatrix(10);
+        auto instance = std::make_shared<MeshInstance>(mesh, matrix, mat);
+        auto transform = std::make_shared<Transform>(triangles, matrix);
+        scene.bvh_object[transform.get()] = instance.get();
+        scene.list.add(transform);
+        scene.list.add(instance);
+    }
+    for (int i = 0; i < 20; ++i) {
+        auto sphere = std::make_shared<Sphere>(Point3(0, 0, 0),
+                                               uniform(0.2, 1.5), mat);
+        scene.list.add(std::make_shared<Transform>(sphere, randomMatrix(10)));
+    }
+    for (int i = 0; i < 20; ++i) {
+        auto box = makeBox(Point3(0, 0, 0),
+                           Point3(uniform(0.2, 2), uniform(0.2, 2),
+                                  uniform(0.2, 2)), mat);
+        scene.list.add(std::make_shared<Transform>(box, randomMatrix(10)));
+    }
+    return scene;
+}
+
+/**
+ * Splits a scene into what the BVH side and the brute-force side test. The
+ * objects the BVH side reports something else for are brute-force only,
+ * and the ones they're reported as are BVH only.
+ */
+void splitScene(const Scene & scene, HittableList & bvh_side,
+                HittableList & brute_side) {
+    std::map<const Hittable *, bool> replacements;
+    for (const auto & entry : scene.bvh_object) {
+        replacements[entry.second] = true;
+    }
+    for (const auto & object : scene.list.objects_) {
+        if (scene.bvh_object.count(object.get())) {
+            brute_side.add(object);
+        }
+        else if (replacements.count(object.get())) {
+            bvh_side.add(object);
+        }
+        else {
+            bvh_side.add(object);
+            brute_side.add(object);
+        }
+    }
+}
+
+/**
+ * Fires random rays at a scene, and counts the ones where the BVH and the
+ * brute-force list disagree.
+ */
+int checkScene(const Scene & scene, const HittableList & bvh_side,
+               const HittableList & brute_side, BVHSplitMethod method,
+               const char * method_name, int num_rays) {
+    BVHTree bvh(bvh_side, method);
+    AABB box;
+    brute_side.boundingBox(box);
+    Vec3 extent = box.max() - box.min();
+    double size = std::max(extent.x(), std::max(extent.y(), extent.z()));
+
+    int hits = 0;
+    int failures = 0;
+    for (int i = 0; i < num_rays; ++i) {
+        // Start anywhere around the scene. Half the rays aim at a point
+        // inside it, so plenty of them hit something.
+        Point3 origin;
+        for (int a = 0; a < 3; ++a) {
+            origin[a] = uniform(box.min()[a] - size / 2,
+                                box.max()[a] + size / 2);
+        }
+        Vec3 direction;
+        if (i % 2 == 0) {
+            Point3 target;
+            for (int a = 0; a < 3; ++a) {
+                target[a] = uniform(box.min()[a], box.max()[a]);
+            }
+            direction = target - origin;
+        }
+        else {
+            direction = Vec3(uniform(-1, 1), uniform(-1, 1), uniform(-1, 1));
+        }
+        Ray ray(origin, direction);
+        double scale = size / direction.length();
+        double tmin = rng.nextDouble() < 0.25
+            ? 0.001 : uniform(0, scale);
+        double tmax = rng.nextDouble() < 0.25
+            ? std::numeric_limits<double>::max()
+            : tmin + uniform(0, 2 * scale);
+
+        hit_record bvh_record, brute_record;
+        bool bvh_hit = bvh.hit(ray, tmin, tmax, bvh_record);
+        bool brute_hit = brute_side.hit(ray, tmin, tmax, brute_record);
+        bool bvh_occluded = bvh.occluded(ray, tmin, tmax);
+        hits += brute_hit;
+
+        // With different precisions, a hit right at the end of the window
+        // can land on either side of it.
+        double slack = scene.tolerance * std::max(1.0, std::fabs(tmin));
+        auto near_edge = [&](double t) {
+            return t - tmin <= slack || tmax - t <= scene.tolerance * t;
+        };
+
+        std::string problem;
+        if (bvh_hit != brute_hit) {
+            double t = bvh_hit ? bvh_record.t : brute_record.t;
+            if (!near_edge(t))
+                problem = bvh_hit ? "BVH hit, list missed"
+                                  : "BVH missed, list hit";
+        }
+        else if (bvh_hit) {
+            auto found = scene.bvh_object.find(brute_record.object);
+            const Hittable * expected = found == scene.bvh_object.end()
+                ? brute_record.object : found->second;
+            double difference = std::fabs(bvh_record.t - brute_record.t);
+            if (difference > scene.tolerance * brute_record.t) {
+                problem = "different distances";
+            }
+            else if (bvh_record.object != expected) {
+                problem = "different objects";
+            }
+        }
+        if (problem.empty() && bvh_occluded != bvh_hit) {
+            problem = "occluded() disagrees with hit()";
+        }
+        if (!problem.empty()) {
+            if (++failures <= 10) {
+                std::cerr << "  ray " << i << ": " << problem
+                          << " (BVH t = " << (bvh_hit ? bvh_record.t : -1)
+                          << ", list t = "
+                          << (brute_hit ? brute_record.t : -1)
+                          << ", window [" << tmin << ", " << tmax << "])\n";
+            }
+        }
+    }
+    std::cout << (failures ? "FAIL " : "ok   ") << scene.name << ", "
+              << method_name << ": " << num_rays << " rays, " << hits
+              << " hits, " << failures << " disagreements\n";
+    return failures;
+}
+
+} // namespace
+
+
+int main(int argc, char * argv[]) {
+    int num_rays = argc > 1 ? std::atoi(argv[1]) : 4000;
+    uint64_t seed = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1;
+    rng.setSeed(seed, 1);
+
+    auto mat = std::make_shared<BasicLambertian>(RGBColor(0.5, 0.5, 0.5));
+    std::vector<Scene> scenes;
+    scenes.push_back(primitiveScene(mat));
+    scenes.push_back(meshScene(mat));
+    scenes.push_back(instanceScene(mat));
+
+    struct Method {
+        BVHSplitMethod method;
+        const char * name;
+    } methods[] = {
+        {BVHSplitMethod::MIDPOINT, "midpoint"},
+        {BVHSplitMethod::SAH, "SAH"},
+        {BVHSplitMethod::LBVH, "LBVH"}
+    };
+
+    int failures = 0;
+    for (const Scene & scene : scenes) {
+        HittableList bvh_side, brute_side;
+        splitScene(scene, bvh_side, brute_side);
+        for (const Method & method : methods) {
+            failures += checkScene(scene, bvh_side, brute_side, method.method,
+                                   method.name, num_rays);
+        }
+    }
+    if (failures) {
+        std::cout << failures << " rays disagreed" << std::endl;
+        return 1;
+    }
+    std::cout << "All rays agreed" << std::endl;
+    return 0;
+}
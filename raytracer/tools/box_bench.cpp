@@ -0,0 +1,203 @@
+/**
+ * @file box_bench.cpp
+ * @author Ian Rudnick
+ * Microbenchmark for ray/box slab tests.
+ * Tests a set of random rays against a set of random boxes, and prints how
+ * many box tests per second each version of the test gets through. The
+ * "before" versions are the old tests, which worked out the inverse
+ * direction and swapped the slab ends on its sign inside every test. The
+ * "after" versions read the data the Ray precomputes when it is made.
+ *
+ * Usage: box_bench [rays] [boxes] [repeats]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#include "aabb.h"
+#include "linear_bvh.h"
+#include "ray.h"
+#include "rng.h"
+#include "vec3.h"
+
+using namespace rudnick_rt;
+
+namespace {
+
+/**
+ * The slab test AABB::hit used before rays carried their inverse direction.
+ */
+bool oldAABBHit(const AABB & box, const Ray & ray, double tmin, double tmax) {
+    for (int i = 0; i < 3; i++) {
+        auto inv_dir = 1.0f / ray.direction()[i];
+        auto t0 = (box.min()[i] - ray.origin()[i]) * inv_dir;
+        auto t1 = (box.max()[i] - ray.origin()[i]) * inv_dir;
+
+        if (inv_dir < 0.0f) {
+            std::swap(t0, t1);
+        }
+        tmin = t0 > tmin ? t0 : tmin;
+        tmax = t1 < tmax ? t1 : tmax;
+
+        if (tmax <= tmin) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool newAABBHit(const AABB & box, const Ray & ray, double tmin, double tmax) {
+    return box.hit(ray, tmin, tmax);
+}
+
+/**
+ * The slab test LinearBVHNode::hit used before, with the inverse direction
+ * worked out once per traversal but the sign still checked in every test.
+ */
+bool oldNodeHit(const LinearBVHNode & node, const Point3 & origin,
+                const Vec3 & inv_dir, double tmin, double tmax) {
+    for (int i = 0; i < 3; ++i) {
+        double t0 = (node.min[i] - origin[i]) * inv_dir[i];
+        double t1 = (node.max[i] - origin[i]) * inv_dir[i];
+        if (inv_dir[i] < 0) {
+            double temp = t0;
+            t0 = t1;
+            t1 = temp;
+        }
+        tmin = t0 > tmin ? t0 : tmin;
+        tmax = t1 < tmax ? t1 : tmax;
+        if (tmax < tmin) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Runs a benchmark a few times and keeps the fastest run, since the slower
+ * ones mostly measure whatever else the machine was doing.
+ * @return Box tests per second, in millions.
+ */
+template <typename Body>
+double bestRate(int repeats, double tests, size_t & hits, Body body) {
+    double best = 0;
+    for (int r = 0; r < repeats; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        hits = body();
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        best = std::max(best, tests / elapsed.count() / 1e6);
+    }
+    return best;
+}
+
+} // namespace
+
+
+int main(int argc, char * argv[]) {
+    size_t num_rays = argc > 1 ? std::atoi(argv[1]) : 1024;
+    size_t num_boxes = argc > 2 ? std::atoi(argv[2]) : 1024;
+    int repeats = argc > 3 ? std::atoi(argv[3]) : 5;
+    double tests = double(num_rays) * num_boxes;
+
+    // Rays start inside a 20-unit cube and point anywhere; boxes are up to
+    // 2 units wide, scattered through the same cube. About a fifth hit.
+    RNG rng(1, 1);
+    auto uniform = [&rng](double min, double max) {
+        return min + (max - min) * rng.nextDouble();
+    };
+    std::vector<Point3> origins;
+    std::vector<Vec3> directions;
+    for (size_t i = 0; i < num_rays; ++i) {
+        origins.push_back(Point3(uniform(-10, 10), uniform(-10, 10),
+                                 uniform(-10, 10)));
+        directions.push_back(Vec3(uniform(-1, 1), uniform(-1, 1),
+                                  uniform(-1, 1)));
+    }
+    std::vector<AABB> boxes;
+    std::vector<LinearBVHNode> nodes(num_boxes);
+    for (size_t i = 0; i < num_boxes; ++i) {
+        Point3 min(uniform(-10, 10), uniform(-10, 10), uniform(-10, 10));
+        Point3 max = min + Vec3(uniform(0, 2), uniform(0, 2), uniform(0, 2));
+        boxes.push_back(AABB(min, max));
+        for (int k = 0; k < 3; ++k) {
+            nodes[i].min[k] = static_cast<float>(min[k]);
+            nodes[i].max[k] = static_cast<float>(max[k]);
+        }
+    }
+
+    // Make the rays up front; making them is timed on its own below.
+    std::vector<Ray> rays;
+    for (size_t i = 0; i < num_rays; ++i)
+        rays.push_back(Ray(origins[i], directions[i]));
+
+    // Call the AABB tests through pointers, so neither one gets inlined
+    // into the loop when the other can't be.
+    bool (* volatile old_aabb)(const AABB &, const Ray &, double, double) =
+        oldAABBHit;
+    bool (* volatile new_aabb)(const AABB &, const Ray &, double, double) =
+        newAABBHit;
+
+    std::cout << num_rays << " rays x " << num_boxes << " boxes, best of "
+              << repeats << " runs, million box tests per second\n";
+
+    size_t hits = 0;
+    auto run_aabb = [&](bool (*test)(const AABB &, const Ray &,
+                                     double, double)) {
+        return bestRate(repeats, tests, hits, [&]() {
+            size_t count = 0;
+            for (const Ray & ray : rays) {
+                for (const AABB & box : boxes)
+                    count += test(box, ray, 0.001, 1e30);
+            }
+            return count;
+        });
+    };
+    double rate = run_aabb(old_aabb);
+    std::cout << "AABB::hit, before:          " << rate
+              << "  (" << hits << " hits)\n";
+    rate = run_aabb(new_aabb);
+    std::cout << "AABB::hit, after:           " << rate
+              << "  (" << hits << " hits)\n";
+
+    rate = bestRate(repeats, tests, hits, [&]() {
+        size_t count = 0;
+        for (size_t i = 0; i < num_rays; ++i) {
+            Vec3 inv_dir(1.0 / directions[i].x(), 1.0 / directions[i].y(),
+                         1.0 / directions[i].z());
+            for (const LinearBVHNode & node : nodes)
+                count += oldNodeHit(node, origins[i], inv_dir, 0.001, 1e30);
+        }
+        return count;
+    });
+    std::cout << "LinearBVHNode::hit, before: " << rate
+              << "  (" << hits << " hits)\n";
+    rate = bestRate(repeats, tests, hits, [&]() {
+        size_t count = 0;
+        for (const Ray & ray : rays) {
+            for (const LinearBVHNode & node : nodes)
+                count += node.hit(ray, 0.001, 1e30);
+        }
+        return count;
+    });
+    std::cout << "LinearBVHNode::hit, after:  " << rate
+              << "  (" << hits << " hits)\n";
+
+    // What the precomputing costs: making a ray now takes three divisions.
+    size_t made = 0;
+    rate = bestRate(repeats, tests, made, [&]() {
+        size_t count = 0;
+        for (size_t r = 0; r < num_boxes; ++r) {
+            for (size_t i = 0; i < num_rays; ++i) {
+                Ray ray(origins[i], directions[i]);
+                count += ray.dirIsNeg()[0];
+            }
+        }
+        return count;
+    });
+    std::cout << "Ray constructions:          " << rate << " million/s\n";
+    return 0;
+}
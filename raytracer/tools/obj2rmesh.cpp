@@ -0,0 +1,59 @@
+/**
+ * @file obj2rmesh.cpp
+ * @author Ian Rudnick
+ * Converts an OBJ file to a binary mesh file that the ray tracer can load
+ * without parsing or building anything.
+ *
+ * Usage: obj2rmesh input.obj output.rmesh [--no-bvh]
+ */
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "triangle_mesh.h"
+
+using namespace rudnick_rt;
+
+int main(int argc, char * argv[]) {
+    bool include_bvh = true;
+    std::string input, output;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--no-bvh") == 0) {
+            include_bvh = false;
+        }
+        else if (input.empty()) {
+            input = argv[i];
+        }
+        else if (output.empty()) {
+            output = argv[i];
+        }
+    }
+    if (input.empty() || output.empty()) {
+        std::cerr << "Usage: " << argv[0]
+                  << " input.obj output.rmesh [--no-bvh]\n"
+                  << "  --no-bvh  Leave out the BVH, so it's built at load"
+                  << " time instead.\n";
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    TriangleMesh mesh(input, nullptr, false);
+    if (mesh.numTriangles() == 0) {
+        std::cerr << "No triangles loaded from " << input << "\n";
+        return 1;
+    }
+    std::chrono::duration<double> duration =
+        std::chrono::steady_clock::now() - start;
+    std::cout << "Loaded " << mesh.numTriangles() << " triangles and "
+              << mesh.numVertices() << " vertices in " << duration.count()
+              << " seconds\n";
+
+    if (!mesh.save(output, include_bvh)) {
+        std::cerr << "Could not write " << output << "\n";
+        return 1;
+    }
+    std::cout << "Wrote " << output
+              << (include_bvh ? " with its BVH\n" : " without a BVH\n");
+    return 0;
+}